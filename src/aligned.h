@@ -0,0 +1,56 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_ALIGNED_H
+#define SRC_ALIGNED_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/*
+ * Storage for Vector, Matrix, VectorBatch:
+ * a std::vector whose data starts on a cache line,
+ * so that a 64-byte vector load from the start of the data,
+ * or of any padded row, see padded_size, never straddles two lines.
+ */
+constexpr std::size_t cacheline_bytes = 64;
+
+template< typename T >
+struct aligned_allocator {
+  using value_type = T;
+  aligned_allocator() = default;
+  template< typename U >
+  aligned_allocator( const aligned_allocator<U>& ) {};
+  T *allocate( std::size_t n ) {
+    return static_cast<T*>
+      ( ::operator new( n*sizeof(T),std::align_val_t(cacheline_bytes) ) );
+  };
+  void deallocate( T *p,std::size_t ) {
+    ::operator delete( p,std::align_val_t(cacheline_bytes) );
+  };
+};
+template< typename T,typename U >
+bool operator==( const aligned_allocator<T>&,const aligned_allocator<U>& ) { return true; };
+template< typename T,typename U >
+bool operator!=( const aligned_allocator<T>&,const aligned_allocator<U>& ) { return false; };
+
+using aligned_vector = std::vector< float,aligned_allocator<float> >;
+
+//! n floats rounded up to whole cache lines: the padded row length
+inline int padded_size( int n ) {
+  constexpr int line = cacheline_bytes/sizeof(float);
+  return ( (n+line-1)/line )*line;
+};
+
+#endif //SRC_ALIGNED_H
@@ -0,0 +1,274 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "blas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+/*
+ * Size- and shape-based dispatch between the backends.
+ *
+ * Products are put in size classes by their volume m n k,
+ * with the class edges the cubes of 4,8,...,256,
+ * and in two shape classes: `thin' if the smallest of m,n,k
+ * is less than a quarter of the cube root of the volume,
+ * such as a small batch or a small output layer, and `square' otherwise.
+ * At the first product we time every backend
+ * on an s x s x s product for each edge s, and on a thin one
+ * of the same volume, q x t x q with t=s/8;
+ * and record the fastest one for each class;
+ * products beyond the last edge use the winner of the last class.
+ * Matrix-vector products are timed separately, on s x s matrices
+ * for s=16,32,...,1024, and put in classes by m n.
+ * This takes some tens of milliseconds, and typically gives
+ * the reference code for tiny networks and a library for MNIST.
+ *
+ * The probe can be skipped by setting EDUDL_BLAS
+ * to the name of a backend (reference, simd, blis, cblas);
+ * that one is then used for everything.
+ */
+
+namespace {
+
+  const vector<int> edges{4,8,16,32,64,128,256};
+  const vector<int> gemv_edges{16,32,64,128,256,512,1024};
+  enum product_shape { square=0,thin=1 };
+
+  vector<const blas_kernels*> available_backends() {
+    vector<const blas_kernels*> backends{ &blas_reference_kernels,&blas_simd_kernels };
+#ifdef BLISNN
+    backends.push_back( &blas_blis_kernels );
+#endif
+#ifdef USE_CBLAS
+    backends.push_back( &blas_cblas_kernels );
+#endif
+    return backends;
+  }
+
+  // best time in seconds of f(), which does `work' flops
+  template< typename F >
+  double best_time( double work,F f ) {
+    using myclock = std::chrono::steady_clock;
+    const int reps = std::max( 1.,(1<<21)/work );
+    f();
+    double best{1.e30};
+    for (int trial=0; trial<3; trial++) {
+      auto start = myclock::now();
+      for (int r=0; r<reps; r++)
+	f();
+      const double t = std::chrono::duration<double>( myclock::now()-start ).count()/reps;
+      best = std::min( best,t );
+    }
+    return best;
+  }
+
+  // one m x n x k product
+  double time_product( const blas_kernels &kernels,int m,int n,int k ) {
+    vector<float> a(m*k,.5f), b(k*n,.25f), c(m*n,0.f);
+    return best_time
+      ( static_cast<double>(m)*n*k,[&] () {
+	kernels.gemm( false,false, m,n,k, 1.f, a.data(),m, b.data(),k, 0.f, c.data(),m );
+      } );
+  }
+
+  // one s x s matrix-vector product, transposed as in Matrix::mvp
+  double time_matvec( const blas_kernels &kernels,int s ) {
+    vector<float> a(s*s,.5f), x(s,.25f), y(s,0.f);
+    return best_time
+      ( static_cast<double>(s)*s,[&] () {
+	kernels.gemv( true, s,s, 1.f, a.data(),s, x.data(),1, 0.f, y.data(),1 );
+      } );
+  }
+
+  // the shape of the thin probe for edge s: q x t x q
+  int thin_side( int s ) { return std::max( 1,s/8 ); };
+  int thin_length( int s ) {
+    return static_cast<int>( std::sqrt( static_cast<double>(s)*s*s/thin_side(s) ) );
+  };
+
+  // the fastest backend for each class, timed by time(backend,class)
+  template< typename Time >
+  vector<const blas_kernels*> fastest
+      ( const vector<const blas_kernels*> &backends,int nclasses,Time time ) {
+    vector<const blas_kernels*> best( nclasses,backends.front() );
+    for (int ic=0; ic<nclasses; ic++) {
+      double tbest{1.e30};
+      for ( auto b : backends ) {
+	const double t = time( *b,ic );
+	if (t<tbest) { tbest = t; best[ic] = b; }
+      }
+    }
+    return best;
+  }
+
+  // "reference from 0, simd from 16^3" for the classes given by edges
+  string describe
+      ( const vector<const blas_kernels*> &best,const vector<int> &edges,const string &power ) {
+    string description;
+    for (size_t ic=0; ic<edges.size(); ic++) {
+      if (ic==0 or best[ic]!=best[ic-1]) {
+	if (ic>0) description += ", ";
+	description += string(best[ic]->name) + " from "
+	  + ( ic==0 ? string("0") : std::to_string(edges[ic-1])+power );
+      }
+    }
+    return description;
+  }
+
+  struct dispatch_table {
+    vector<const blas_kernels*> gemm_best[2], gemv_best;
+    string description;
+    dispatch_table() {
+      const auto backends = available_backends();
+      const char *env = std::getenv("EDUDL_BLAS");
+      const blas_kernels *forced{nullptr};
+      if (env!=nullptr) {
+	for ( auto b : backends )
+	  if ( string(env)==b->name )
+	    forced = b;
+	if (forced==nullptr) {
+	  std::cerr << "EDUDL_BLAS=" << env << " is not one of:";
+	  for ( auto b : backends )
+	    std::cerr << " " << b->name;
+	  std::cerr << "; timing the backends instead\n";
+	}
+      }
+      const int nedges = edges.size(), ngemv = gemv_edges.size();
+      if (forced!=nullptr or backends.size()==1) {
+	const auto b = ( forced!=nullptr ? forced : backends.front() );
+	gemm_best[square] = gemm_best[thin] = vector<const blas_kernels*>( nedges,b );
+	gemv_best = vector<const blas_kernels*>( ngemv,b );
+      } else {
+	gemm_best[square] = fastest
+	  ( backends,nedges,[] ( const blas_kernels &b,int ic ) {
+	    const int s = edges[ic];
+	    return time_product( b,s,s,s ); } );
+	gemm_best[thin] = fastest
+	  ( backends,nedges,[] ( const blas_kernels &b,int ic ) {
+	    const int s = edges[ic], q = thin_length(s);
+	    return time_product( b,q,thin_side(s),q ); } );
+	gemv_best = fastest
+	  ( backends,ngemv,[] ( const blas_kernels &b,int ic ) {
+	    return time_matvec( b,gemv_edges[ic] ); } );
+      }
+      description = "square " + describe( gemm_best[square],edges,"^3" )
+	+ "; thin " + describe( gemm_best[thin],edges,"^3" )
+	+ "; gemv " + describe( gemv_best,gemv_edges,"^2" );
+    }
+  };
+
+  const dispatch_table &table() {
+    static const dispatch_table t;
+    return t;
+  }
+
+  // the first class whose edge^power is at least size
+  int size_class( double size,const vector<int> &edges,int power ) {
+    for (size_t ic=0; ic<edges.size(); ic++)
+      if (size<=std::pow( static_cast<double>(edges[ic]),power ))
+	return ic;
+    return edges.size()-1;
+  }
+
+}
+
+const blas_kernels &blas_select( int m,int n,int k ) {
+  const double volume = static_cast<double>(m)*n*k;
+  const int shape = ( 4.*std::min({m,n,k})<std::cbrt(volume) ? thin : square );
+  return *table().gemm_best[shape][ size_class( volume,edges,3 ) ];
+}
+
+const blas_kernels &blas_select_gemv( int m,int n ) {
+  return *table().gemv_best[ size_class( static_cast<double>(m)*n,gemv_edges,2 ) ];
+}
+
+const char *blas_backend() {
+  return table().description.c_str();
+}
+
+/*
+ * The interface routines just forward to the selected backend
+ */
+void blas_sgemm
+    ( bool transa,bool transb,int m,int n,int k,
+      float alpha,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float beta,
+      float *c,int ldc ) {
+  blas_select(m,n,k).gemm
+    ( transa,transb,m,n,k, alpha, a,lda, b,ldb, beta, c,ldc );
+}
+
+void blas_sgemv
+    ( bool trans,int m,int n,
+      float alpha,
+      const float *a,int lda,
+      const float *x,int incx,
+      float beta,
+      float *y,int incy ) {
+  blas_select_gemv(m,n).gemv
+    ( trans,m,n, alpha, a,lda, x,incx, beta, y,incy );
+}
+
+void blas_sgemm_bias_act
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *bias,acFunc f,int approximation ) {
+  blas_select(m,n,k).gemm_bias_act
+    ( transa,transb,m,n,k, a,lda, b,ldb, c,ldc, bias,f,approximation );
+}
+
+void blas_sgemm_act_grad
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *act,acFunc f ) {
+  blas_select(m,n,k).gemm_act_grad
+    ( transa,transb,m,n,k, a,lda, b,ldb, c,ldc, act,f );
+}
+
+/*
+ * The vector is short, so the bias and activation
+ * are one pass over y after the gemv, which leaves it in cache;
+ * no threading here, this is about latency.
+ */
+void blas_sgemv_bias_act
+    ( bool trans,int m,int n,
+      const float *a,int lda,
+      const float *x,
+      float *y,
+      const float *bias,acFunc f,int approximation ) {
+  blas_select_gemv(m,n).gemv
+    ( trans,m,n, 1.f, a,lda, x,1, 0.f, y,1 );
+  const int ny = ( trans ? n : m );
+  for (int i=0; i<ny; i++)
+    y[i] += bias[i];
+  with_elementwise_activation
+    ( f,[=] ( auto act ) {
+      using Act = decltype(act);
+      if constexpr (not Act::linear)
+	Act::array( ny,y,y,approximation );
+    } );
+}
@@ -0,0 +1,112 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_BLAS_H
+#define SRC_BLAS_H
+
+#include "funcs.h"
+
+/*
+ * Backend interface for the dense products.
+ * All Matrix and VectorBatch products go through these routines.
+ * Every backend provides a blas_kernels table, in a blas_impl_*.cpp file.
+ * The reference one and the simd one, which checks the processor at run time,
+ * are always there; the libraries are linked in with USE_BLIS / USE_CBLAS
+ * in Make.inc.
+ * Each call is dispatched on the size of the product, see blas.cpp,
+ * so that small products avoid the fixed overhead of the libraries.
+ *
+ * The conventions are those of the reference BLAS:
+ * column-major storage with leading dimensions, and transpose flags.
+ * A row-major Matrix is passed as the transpose of a column-major one.
+ */
+
+// C <- alpha op(A) op(B) + beta C,  with op(A) m x k, op(B) k x n, C m x n
+void blas_sgemm
+    ( bool transa,bool transb,int m,int n,int k,
+      float alpha,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float beta,
+      float *c,int ldc );
+
+// y <- alpha op(A) x + beta y,  with A m x n
+void blas_sgemv
+    ( bool trans,int m,int n,
+      float alpha,
+      const float *a,int lda,
+      const float *x,int incx,
+      float beta,
+      float *y,int incy );
+
+/*
+ * Fused products for the network layers.
+ * Forward:  C <- act( op(A) op(B) + bias 1^t ), bias indexed by row of C;
+ *           for SMAX only the bias is applied; the sigmoid uses
+ *           the exponential of degree approximation, see vmath.h.
+ * Backward: C <- op(A) op(B) .* act'( Act ),
+ *           with Act stored with the same leading dimension as C;
+ *           SMAX is treated as NONE.
+ */
+void blas_sgemm_bias_act
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *bias,acFunc f,int approximation=0 );
+void blas_sgemm_act_grad
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *act,acFunc f );
+
+/*
+ * Single sample forward, for inference:
+ * y <- act( op(A) x + bias ), with A m x n;
+ * for SMAX only the bias is applied; approximation as above.
+ */
+void blas_sgemv_bias_act
+    ( bool trans,int m,int n,
+      const float *a,int lda,
+      const float *x,
+      float *y,
+      const float *bias,acFunc f,int approximation=0 );
+
+/*
+ * The kernels of one backend
+ */
+struct blas_kernels {
+  const char *name;
+  void (*gemm)
+    ( bool,bool,int,int,int, float,const float*,int,const float*,int, float,float*,int );
+  void (*gemv)
+    ( bool,int,int, float,const float*,int,const float*,int, float,float*,int );
+  void (*gemm_bias_act)
+    ( bool,bool,int,int,int, const float*,int,const float*,int, float*,int, const float*,acFunc,int );
+  void (*gemm_act_grad)
+    ( bool,bool,int,int,int, const float*,int,const float*,int, float*,int, const float*,acFunc );
+};
+extern const blas_kernels
+  blas_reference_kernels, blas_simd_kernels, blas_blis_kernels, blas_cblas_kernels;
+
+/*
+ * Which backend handles a product of m x n x k,
+ * which one a matrix-vector product with an m x n matrix,
+ * and a description of the whole dispatch table, for reporting
+ */
+const blas_kernels &blas_select( int m,int n,int k );
+const blas_kernels &blas_select_gemv( int m,int n );
+const char *blas_backend();
+
+#endif //SRC_BLAS_H
@@ -0,0 +1,86 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "blas.h"
+#include "blas_panels.h"
+
+#ifdef BLISNN
+#include "blis/blis.h"
+#endif
+
+/*
+ * Backend on top of the BLIS typed API, see
+ * https://github.com/flame/blis/blob/master/docs/BLISTypedAPI.md#gemm
+ * BLIS takes a row and column stride, rather than a leading dimension;
+ * column-major means row stride 1, and the transpose is a flag.
+ */
+static inline trans_t op( bool trans ) {
+  return ( trans ? BLIS_TRANSPOSE : BLIS_NO_TRANSPOSE );
+};
+
+static void sgemm
+    ( bool transa,bool transb,int m,int n,int k,
+      float alpha,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float beta,
+      float *c,int ldc ) {
+  bli_sgemm( op(transa),op(transb),
+	     m,n,k,
+	     &alpha,
+	     const_cast<float*>(a), /* rsa,csa */ 1,lda,
+	     const_cast<float*>(b), /* rsb,csb */ 1,ldb,
+	     &beta,
+	     c,                     /* rsc,csc */ 1,ldc
+	     );
+}
+
+static void sgemv
+    ( bool trans,int m,int n,
+      float alpha,
+      const float *a,int lda,
+      const float *x,int incx,
+      float beta,
+      float *y,int incy ) {
+  bli_sgemv( op(trans), BLIS_NO_CONJUGATE,
+	     m,n,
+	     &alpha,
+	     const_cast<float*>(a), /* rsa,csa */ 1,lda,
+	     const_cast<float*>(x), incx,
+	     &beta,
+	     y, incy
+	     );
+}
+
+static void sgemm_bias_act
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *bias,acFunc f,int approximation ) {
+  blas_panels_bias_act
+    ( sgemm, transa,transb,m,n,k, a,lda, b,ldb, c,ldc, bias,f,approximation );
+}
+
+static void sgemm_act_grad
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *act,acFunc f ) {
+  blas_panels_act_grad
+    ( sgemm, transa,transb,m,n,k, a,lda, b,ldb, c,ldc, act,f );
+}
+
+const blas_kernels blas_blis_kernels
+  { "blis", sgemm, sgemv, sgemm_bias_act, sgemm_act_grad };
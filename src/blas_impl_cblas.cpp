@@ -0,0 +1,77 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "blas.h"
+#include "blas_panels.h"
+
+/*
+ * Backend on top of any CBLAS: OpenBLAS, MKL, ATLAS, ...
+ * MKL ships its CBLAS prototypes as mkl_cblas.h,
+ * selected with CBLAS_MKL=1 in Make.inc.
+ */
+#ifdef CBLAS_MKL
+#include "mkl_cblas.h"
+#else
+#include "cblas.h"
+#endif
+
+static inline CBLAS_TRANSPOSE op( bool trans ) {
+  return ( trans ? CblasTrans : CblasNoTrans );
+};
+
+static void sgemm
+    ( bool transa,bool transb,int m,int n,int k,
+      float alpha,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float beta,
+      float *c,int ldc ) {
+  if (m==0 or n==0) return;
+  cblas_sgemm( CblasColMajor, op(transa),op(transb),
+	       m,n,k, alpha, a,lda, b,ldb, beta, c,ldc );
+}
+
+static void sgemv
+    ( bool trans,int m,int n,
+      float alpha,
+      const float *a,int lda,
+      const float *x,int incx,
+      float beta,
+      float *y,int incy ) {
+  if (m==0 or n==0) return;
+  cblas_sgemv( CblasColMajor, op(trans),
+	       m,n, alpha, a,lda, x,incx, beta, y,incy );
+}
+
+static void sgemm_bias_act
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *bias,acFunc f,int approximation ) {
+  blas_panels_bias_act
+    ( sgemm, transa,transb,m,n,k, a,lda, b,ldb, c,ldc, bias,f,approximation );
+}
+
+static void sgemm_act_grad
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *act,acFunc f ) {
+  blas_panels_act_grad
+    ( sgemm, transa,transb,m,n,k, a,lda, b,ldb, c,ldc, act,f );
+}
+
+const blas_kernels blas_cblas_kernels
+  { "cblas", sgemm, sgemv, sgemm_bias_act, sgemm_act_grad };
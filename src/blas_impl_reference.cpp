@@ -0,0 +1,97 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "blas.h"
+#include "gemm.h"
+
+/*
+ * Backend on top of our own blocked gemm.
+ * Column-major with leading dimension ld means
+ * row stride 1 and column stride ld, swapped for a transpose.
+ */
+static inline int rs( bool trans,int ld ) { return ( trans ? ld : 1 ); };
+static inline int cs( bool trans,int ld ) { return ( trans ? 1 : ld ); };
+
+static void sgemm
+    ( bool transa,bool transb,int m,int n,int k,
+      float alpha,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float beta,
+      float *c,int ldc ) {
+  gemm_reference( m,n,k, alpha,
+		  a, rs(transa,lda),cs(transa,lda),
+		  b, rs(transb,ldb),cs(transb,ldb),
+		  beta, c, 1,ldc );
+}
+
+static void sgemv
+    ( bool trans,int m,int n,
+      float alpha,
+      const float *a,int lda,
+      const float *x,int incx,
+      float beta,
+      float *y,int incy ) {
+  if (not trans) {
+    for (int i=0; i<m; i++) {
+      float s{0.f};
+      for (int j=0; j<n; j++)
+	s += a[ i+j*lda ] * x[ j*incx ];
+      y[ i*incy ] = alpha*s + ( beta==0.f ? 0.f : beta*y[ i*incy ] );
+    }
+  } else {
+    // dot products down the columns: keep a few partial sums
+    // so that the compiler can vectorize without reassociating
+    const int w = 8, mw = ( incx==1 ? m-m%w : 0 );
+    for (int j=0; j<n; j++) {
+      const float *acol = a+j*lda;
+      float p[w]{};
+      for (int i=0; i<mw; i+=w)
+	for (int ii=0; ii<w; ii++)
+	  p[ii] += acol[ i+ii ] * x[ i+ii ];
+      float s{0.f};
+      for (int ii=0; ii<w; ii++)
+	s += p[ii];
+      for (int i=mw; i<m; i++)
+	s += acol[i] * x[ i*incx ];
+      y[ j*incy ] = alpha*s + ( beta==0.f ? 0.f : beta*y[ j*incy ] );
+    }
+  }
+}
+
+static void sgemm_bias_act
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *bias,acFunc f,int approximation ) {
+  gemm_reference_bias_act( m,n,k,
+			   a, rs(transa,lda),cs(transa,lda),
+			   b, rs(transb,ldb),cs(transb,ldb),
+			   c, 1,ldc, bias,f,approximation );
+}
+
+static void sgemm_act_grad
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *act,acFunc f ) {
+  gemm_reference_act_grad( m,n,k,
+			   a, rs(transa,lda),cs(transa,lda),
+			   b, rs(transb,ldb),cs(transb,ldb),
+			   c, 1,ldc, act,f );
+}
+
+const blas_kernels blas_reference_kernels
+  { "reference", sgemm, sgemv, sgemm_bias_act, sgemm_act_grad };
@@ -0,0 +1,89 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "blas.h"
+#include "gemm.h"
+#include "simd.h"
+
+/*
+ * Backend on top of our own blocked gemm
+ * with the hand-vectorized micro kernels, see simd.h.
+ * Column-major with leading dimension ld means
+ * row stride 1 and column stride ld, swapped for a transpose.
+ */
+static inline int rs( bool trans,int ld ) { return ( trans ? ld : 1 ); };
+static inline int cs( bool trans,int ld ) { return ( trans ? 1 : ld ); };
+
+static void sgemm
+    ( bool transa,bool transb,int m,int n,int k,
+      float alpha,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float beta,
+      float *c,int ldc ) {
+  gemm_simd( m,n,k, alpha,
+	     a, rs(transa,lda),cs(transa,lda),
+	     b, rs(transb,ldb),cs(transb,ldb),
+	     beta, c, 1,ldc );
+}
+
+/*
+ * The simd gemv works on row-major matrices,
+ * so a column-major A is its transpose.
+ * Anything other than y <- op(A) x with unit strides
+ * goes through gemm with a single column.
+ */
+static void sgemv
+    ( bool trans,int m,int n,
+      float alpha,
+      const float *a,int lda,
+      const float *x,int incx,
+      float beta,
+      float *y,int incy ) {
+  if (alpha==1.f and beta==0.f and incx==1 and incy==1) {
+    sgemv_simd( not trans, n,m, a,lda, x,y );
+  } else {
+    const int ny = ( trans ? n : m ), nx = ( trans ? m : n );
+    gemm_simd( ny,1,nx, alpha,
+	       a, rs(trans,lda),cs(trans,lda),
+	       x, incx,1,
+	       beta, y, incy,1 );
+  }
+}
+
+static void sgemm_bias_act
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *bias,acFunc f,int approximation ) {
+  gemm_simd_bias_act( m,n,k,
+		      a, rs(transa,lda),cs(transa,lda),
+		      b, rs(transb,ldb),cs(transb,ldb),
+		      c, 1,ldc, bias,f,approximation );
+}
+
+static void sgemm_act_grad
+    ( bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *act,acFunc f ) {
+  gemm_simd_act_grad( m,n,k,
+		      a, rs(transa,lda),cs(transa,lda),
+		      b, rs(transb,ldb),cs(transb,ldb),
+		      c, 1,ldc, act,f );
+}
+
+const blas_kernels blas_simd_kernels
+  { "simd", sgemm, sgemv, sgemm_bias_act, sgemm_act_grad };
@@ -0,0 +1,94 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_BLAS_PANELS_H
+#define SRC_BLAS_PANELS_H
+
+#include <algorithm>
+#include <vector>
+#include "funcs.h"
+
+/*
+ * Fused products for backends that are a library call:
+ * these have no epilogue, so we go through C
+ * in panels of columns that stay in cache,
+ * and do the elementwise work on a panel right after its gemm.
+ *
+ * The gemm argument is called as
+ *   gemm( transa,transb,m,n,k, alpha,a,lda, b,ldb, beta,c,ldc )
+ * with the conventions of blas.h.
+ */
+namespace blas_panels_detail {
+  inline int panel_width( int m ) { return std::max( 1, 16384/std::max(m,1) ); };
+}
+
+template< typename Gemm >
+void blas_panels_bias_act
+    ( const Gemm &gemm,bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *bias,acFunc f,int approximation ) {
+  const int panel = blas_panels_detail::panel_width(m);
+  for (int j0=0; j0<n; j0+=panel) {
+    const int nj = std::min( panel,n-j0 );
+    float *cpanel = c + j0*ldc;
+    // copy the bias in, and let gemm add the product to it
+    for (int j=0; j<nj; j++)
+      for (int i=0; i<m; i++)
+	cpanel[ i+j*ldc ] = bias[i];
+    gemm( transa,transb, m,nj,k,
+	  1.f, a,lda, b+( transb ? j0 : j0*ldb ),ldb,
+	  1.f, cpanel,ldc );
+    with_elementwise_activation
+      ( f,[&] ( auto act ) {
+	using Act = decltype(act);
+	if constexpr (not Act::linear)
+	  for (int j=0; j<nj; j++)
+	    Act::array( m,cpanel+j*ldc,cpanel+j*ldc,approximation );
+      } );
+  }
+}
+
+template< typename Gemm >
+void blas_panels_act_grad
+    ( const Gemm &gemm,bool transa,bool transb,int m,int n,int k,
+      const float *a,int lda,
+      const float *b,int ldb,
+      float *c,int ldc,
+      const float *act,acFunc f ) {
+  const int panel = blas_panels_detail::panel_width(m);
+  // one column of derivatives, kept around between calls like the gemm packing buffers
+  static thread_local std::vector<float> g;
+  g.resize(m);
+  for (int j0=0; j0<n; j0+=panel) {
+    const int nj = std::min( panel,n-j0 );
+    float *cpanel = c + j0*ldc;
+    const float *apanel = act + j0*ldc;
+    gemm( transa,transb, m,nj,k,
+	  1.f, a,lda, b+( transb ? j0 : j0*ldb ),ldb,
+	  0.f, cpanel,ldc );
+    with_elementwise_activation
+      ( f,[&] ( auto actf ) {
+	using Act = decltype(actf);
+	if constexpr (not Act::linear)
+	  for (int j=0; j<nj; j++) {
+	    Act::grad_array( m,apanel+j*ldc,g.data() );
+	    for (int i=0; i<m; i++)
+	      cpanel[ i+j*ldc ] *= g[i];
+	  }
+      } );
+  }
+}
+
+#endif //SRC_BLAS_PANELS_H
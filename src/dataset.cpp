@@ -179,12 +179,9 @@ std::vector<Dataset> Dataset::batch(int batch_size) const {
   int nbatches = nitems/batch_size + ( nitems%batch_size>0 ? 1 : 0 );
   for (int b=0; b<nbatches; b++) {
     int first = b*batch_size, last= std::min( (b+1)*batch_size,nitems );
-    Dataset batch; //(itemsize,last-first);
+    Dataset batch = slice(first,last-first);
     batch.set_lowerbound(first); batch.set_number(b);
-    for (int i=first; i<last; i++) {
-      batch.push_back( item(i) );
-    }
-    batches.push_back(batch);
+    batches.push_back( std::move(batch) );
   }
 
   return batches;
@@ -223,19 +220,11 @@ std::pair< Dataset,Dataset > Dataset::split(float trainFraction) const {
       trainFraction *= .9;
     }
 
-    Dataset trainSplit;    
 #ifdef DEBUG
     cout << "split into " << trainSize << "+" << testSize << endl;
 #endif
-    for (int i=0; i<trainSize; i++) {
-      const auto& di = item(i);
-      trainSplit.push_back(di);
-    }
-    Dataset testSplit;
-    for (int i=trainSize; i<trainSize+testSize; i++) {
-      const auto& di = item(i);
-      testSplit.push_back(di);
-    }
+    Dataset trainSplit = slice(0,trainSize);
+    Dataset testSplit = slice(trainSize,testSize);
 
     // Dataset trainSplit
     //   ( std::vector<dataItem>(this->_items.begin(), this->_items.begin() + trainSize) );
@@ -243,5 +232,18 @@ std::pair< Dataset,Dataset > Dataset::split(float trainFraction) const {
     // Dataset testSplit
     //   ( std::vector<dataItem>(this->_items.begin() + trainSize, this->_items.end()) );
 
-    return std::make_pair(trainSplit,testSplit);
+    return std::make_pair( std::move(trainSplit),std::move(testSplit) );
+}
+
+/*!
+ * A range of items, as views on the batches of this dataset;
+ * see VectorBatchView. Batching and splitting use this,
+ * so they do not copy any data, but the result is only valid
+ * as long as this dataset is not changed or destroyed.
+ */
+Dataset Dataset::slice(int first,int n) const {
+  Dataset s(nclasses);
+  s.dataBatch  = VectorBatchView( dataBatch,first,n );
+  s.labelBatch = VectorBatchView( labelBatch,first,n );
+  return s;
 }
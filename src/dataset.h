@@ -32,11 +32,19 @@ public:
   dataItem( std::vector<float> indata,std::vector<float> outdata )
     : data( Vector(indata) ),label( Categorization(outdata) ) {};
   int data_size() const { return data.size(); };
-  const std::vector<float>& data_values() const { return data.values(); };
+  const aligned_vector& data_values() const { return data.values(); };
   int label_size() const { return label.size(); };
   const std::vector<float>& label_values() const { return label.probabilities(); };
 };
 
+/*
+ * The items of a dataset, stacked in a data and a label batch.
+ * slice, batch, and split do not copy: their results view the batches
+ * of this dataset, so they are only valid as long as this dataset
+ * is not changed or destroyed. The views are read-only:
+ * push_back on a slice, or any other write, copies its values first
+ * and leaves this dataset unchanged.
+ */
 class Dataset {
 private:
   int nclasses{0};
@@ -80,6 +88,7 @@ public:
     std::vector<Dataset> batch(int n) const; // Divides the dataset into n batches
     void stack();
     std::pair<Dataset,Dataset> split(float trainFraction) const; // Train-test split
+    Dataset slice(int first,int n) const; // Items first..first+n-1, without copying
 };
 
 
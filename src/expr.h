@@ -0,0 +1,187 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_EXPR_H
+#define SRC_EXPR_H
+
+#include <cassert>
+#include <type_traits>
+#include "parallel.h"
+
+/*
+ * Elementwise arithmetic on Vector, Matrix, VectorBatch
+ * with expression templates.
+ * An operator does not compute anything: it returns a small object
+ * that refers to its operands. Only assigning the expression to an object,
+ * or constructing one from it, evaluates it, in a single loop
+ * straight into the destination. So
+ *   weights = weights - lr * dw / sqrtSdw;
+ * is one sweep over the weights, without temporaries.
+ *
+ * Operands are held by reference: an expression must not outlive
+ * the statement it is in, so do not keep one in an `auto' variable.
+ */
+
+template< typename E >
+struct expr {
+  const E &self() const { return static_cast<const E&>(*this); };
+};
+
+/*
+ * A class takes part in expressions if it specializes this
+ * with a static size function.
+ */
+template< typename C >
+struct expr_container : std::false_type {};
+
+// the elements of an object
+template< typename C >
+struct expr_leaf : expr< expr_leaf<C> > {
+  using container = C;
+  const C &object; const float *v; int n;
+  expr_leaf( const C &c )
+    : object(c),v(c.data()),n(expr_container<C>::size(c)) {};
+  int size() const { return n; };
+  const C &shape() const { return object; };
+  float operator[]( int i ) const { return v[i]; };
+};
+
+template< typename Op,typename L,typename R >
+struct expr_binary : expr< expr_binary<Op,L,R> > {
+  using container = typename L::container;
+  static_assert( std::is_same< container,typename R::container >::value,
+		 "elementwise operation on objects of different type" );
+  const L l; const R r;
+  expr_binary( const L &l,const R &r ) : l(l),r(r) {
+    assert( l.size()==r.size() );
+  };
+  int size() const { return l.size(); };
+  const container &shape() const { return l.shape(); };
+  float operator[]( int i ) const { return Op::apply( l[i],r[i] ); };
+};
+
+// scalar on the left: s op e[i]
+template< typename Op,typename E >
+struct expr_scalar_left : expr< expr_scalar_left<Op,E> > {
+  using container = typename E::container;
+  const float s; const E e;
+  expr_scalar_left( float s,const E &e ) : s(s),e(e) {};
+  int size() const { return e.size(); };
+  const container &shape() const { return e.shape(); };
+  float operator[]( int i ) const { return Op::apply( s,e[i] ); };
+};
+
+// scalar on the right: e[i] op s
+template< typename Op,typename E >
+struct expr_scalar_right : expr< expr_scalar_right<Op,E> > {
+  using container = typename E::container;
+  const E e; const float s;
+  expr_scalar_right( const E &e,float s ) : e(e),s(s) {};
+  int size() const { return e.size(); };
+  const container &shape() const { return e.shape(); };
+  float operator[]( int i ) const { return Op::apply( e[i],s ); };
+};
+
+template< typename E >
+struct expr_negate : expr< expr_negate<E> > {
+  using container = typename E::container;
+  const E e;
+  expr_negate( const E &e ) : e(e) {};
+  int size() const { return e.size(); };
+  const container &shape() const { return e.shape(); };
+  float operator[]( int i ) const { return -e[i]; };
+};
+
+// a scalar function applied to every element
+template< typename F,typename E >
+struct expr_function : expr< expr_function<F,E> > {
+  using container = typename E::container;
+  const F f; const E e;
+  expr_function( const F &f,const E &e ) : f(f),e(e) {};
+  int size() const { return e.size(); };
+  const container &shape() const { return e.shape(); };
+  float operator[]( int i ) const { return f( e[i] ); };
+};
+
+struct expr_add { static float apply( float x,float y ) { return x+y; }; };
+struct expr_sub { static float apply( float x,float y ) { return x-y; }; };
+struct expr_mul { static float apply( float x,float y ) { return x*y; }; };
+struct expr_div { static float apply( float x,float y ) { return x/y; }; };
+
+/*
+ * Objects become leaves, expressions are used as is;
+ * anything else has no `type', which takes the operators out of overloading.
+ */
+template< typename T,typename = void >
+struct expr_operand {};
+template< typename T >
+struct expr_operand< T,std::enable_if_t< expr_container<T>::value > > {
+  using type = expr_leaf<T>;
+  static type make( const T &t ) { return type(t); };
+};
+template< typename T >
+struct expr_operand< T,std::enable_if_t< std::is_base_of< expr<T>,T >::value > > {
+  using type = T;
+  static const T &make( const T &t ) { return t; };
+};
+template< typename T >
+using expr_operand_t = typename expr_operand<T>::type;
+
+#define EXPR_OPERATOR(OP,OPNAME)					\
+  template< typename L,typename R,					\
+	    typename LE = expr_operand_t<L>,typename RE = expr_operand_t<R> > \
+  expr_binary<OPNAME,LE,RE> operator OP( const L &l,const R &r ) {	\
+    return expr_binary<OPNAME,LE,RE>					\
+      ( expr_operand<L>::make(l),expr_operand<R>::make(r) );		\
+  };									\
+  template< typename E,typename EE = expr_operand_t<E> >		\
+  expr_scalar_left<OPNAME,EE> operator OP( float s,const E &e ) {	\
+    return expr_scalar_left<OPNAME,EE>( s,expr_operand<E>::make(e) );	\
+  };									\
+  template< typename E,typename EE = expr_operand_t<E> >		\
+  expr_scalar_right<OPNAME,EE> operator OP( const E &e,float s ) {	\
+    return expr_scalar_right<OPNAME,EE>( expr_operand<E>::make(e),s );	\
+  };
+EXPR_OPERATOR(+,expr_add)
+EXPR_OPERATOR(-,expr_sub)
+EXPR_OPERATOR(*,expr_mul)
+EXPR_OPERATOR(/,expr_div)
+#undef EXPR_OPERATOR
+
+template< typename E,typename EE = expr_operand_t<E> >
+expr_negate<EE> operator-( const E &e ) {
+  return expr_negate<EE>( expr_operand<E>::make(e) );
+};
+
+// y = elementwise( [] (float x) { return ...; }, expression );
+template< typename F,typename E,typename EE = expr_operand_t<E> >
+expr_function<F,EE> elementwise( const F &f,const E &e ) {
+  return expr_function<F,EE>( f,expr_operand<E>::make(e) );
+};
+
+/*
+ * The one loop that does the work;
+ * the destination has been sized by the caller.
+ * Element i of the destination only depends on element i of the operands,
+ * so the destination can also appear in the expression.
+ */
+template< typename E >
+void expr_evaluate( const expr<E> &e,float *y ) {
+  const E &x = e.self();
+  const int n = x.size();
+#pragma omp parallel for if(n>=parallel_threshold())
+  for (int i=0; i<n; i++)
+    y[i] = x[i];
+};
+
+#endif //SRC_EXPR_H
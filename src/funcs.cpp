@@ -13,6 +13,7 @@
 
 #include "funcs.h"
 #include "trace.h"
+#include "parallel.h"
 
 #include <iostream>
 using std::cout;
@@ -22,29 +23,58 @@ using std::boolalpha;
 #include <vector>
 using std::vector;
 
+#include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <string>
+
+// the array activations go by blocks of this many elements, a few per thread
+static const int activation_block = 1024;
 
 // VectorBatch input output variants
 
-void relu_io(const VectorBatch &mm, VectorBatch &a) {
-
-  VectorBatch m(mm);
-  assert( a.item_size()==m.item_size() );
-  assert( a.batch_size()==m.batch_size() );
-        auto& avals = a.vals_vector();
-  const auto& mvals = m.vals_vector();
-  avals.assign(mvals.begin(),mvals.end());
-  const float alpha = 0.01; // used for leaky relu, for regular relu, set alpha to 0.0
-  for (int i = 0; i < m.batch_size() * m.item_size(); i++) {
-    // values will be 0 if negative, and equal to themselves if positive
-    if (avals.at(i) < 0)
-      avals.at(i) *= alpha;
-    //cout << i << ":" << avals.at(i) << endl;
-  }
+//! out gets the shape of in, unless it is in
+template< typename Batch >
+static void shape_like( const Batch &in,Batch &out ) {
+  if (&out!=&in)
+    out.resize( in.batch_size(),in.item_size() );
+}
+
+/*
+ * The one loop of the elementwise functions:
+ * every element is read once from in, and written once to out
+ */
+template< typename F >
+static void map_io( const VectorBatch &in,VectorBatch &out,F f ) {
+  shape_like( in,out );
+  const float *x = in.data();
+  float *y = out.data();
+  const int n = in.size();
+#pragma omp parallel for if(n>=parallel_threshold())
+  for (int i = 0; i < n; i++)
+    y[i] = f( x[i] );
+}
+
+/*
+ * The same with a vectorized array kernel, by blocks,
+ * for the activations that need an exponential, and their derivatives
+ */
+template< typename Batch,typename Array >
+static void map_blocks_io( const Batch &in,Batch &out,Array array ) {
+  shape_like( in,out );
+  const float *x = in.data();
+  float *y = out.data();
+  const int n = in.size();
+#pragma omp parallel for if(n>=parallel_threshold())
+  for ( int i=0; i<n; i+=activation_block )
+    array( std::min(activation_block,n-i), x+i,y+i );
+}
+
+void relu_io(const VectorBatch &m, VectorBatch &a) {
+  // values will be scaled down if negative, and equal to themselves if positive
+  map_io( m,a,[] (float e) { return relu_scalar(e); } );
 #ifdef DEBUG
-  m.display("Apply RELU to");
-  a.display("giving");
+  a.display("RELU giving");
 #endif
 }
 
@@ -52,21 +82,19 @@ void relu_io(const VectorBatch &mm, VectorBatch &a) {
 //template <typename VectorBatch>
 void sigmoid_io(const VectorBatch &m, VectorBatch &a) {
 
-    const auto& mvals = m.vals_vector();
-    auto& avals = a.vals_vector();
-    avals.assign(mvals.begin(),mvals.end());
-    // for (int i = 0; i < m.batch_size() * m.item_size(); i++) {
-    //   avals[i] = 1 / (1 + exp(-avals[i]));
-    // }
-    for ( auto& e: avals ) {
-      e = 1.f / ( 1.f + exp( -e ) );
-      if (e<1.e-5) e = 1.e-5;
-      if (e>1-1.e-5) e = 1-1.e-5;
+    shape_like( m,a );
+    const auto& avals = a.vals_vector();
+    const int n = m.size();
+    const float *x = m.data();
+    float *y = a.data();
+#pragma omp parallel for if(n>=parallel_threshold())
+    for ( int i=0; i<n; i+=activation_block ) {
+      vsigmoid( std::min(activation_block,n-i), x+i,y+i, sigmoid_lo,sigmoid_hi );
     }
     if (trace_scalars()) {
       bool limit{true};
       float min{2.f},max{-1.f};
-      for_each( avals.begin(),avals.end(),
+      std::for_each( avals.begin(),avals.end(),
 		[&min,&max,&limit] (auto e) {
 		  assert( not isinf(e) ); assert( not isnan(e) );
 		  if (e<min) min = e; if (e>max) max = e;
@@ -80,94 +108,122 @@ void sigmoid_io(const VectorBatch &m, VectorBatch &a) {
 }
 //codesnippet end
 
-//template <typename VectorBatch>
-void softmax_io(const VectorBatch &m, VectorBatch &a) {
-
-  const int ar = a.item_size(), ac = a.batch_size();
-  vector<float> nB(ac,0);
-  vector<float> mVectorBatch(ac,0);
-
-  for (int i = 0; i < ac; i++) {
-    nB.at(i) = 0.0;
-    mVectorBatch.at(i) = -9999;
-  }
-
-  const auto& mvals = m.vals_vector();
-  auto& avals = a.vals_vector();
-  for (int j = 0; j < ac; j++) {
-    for (int i = 0; i < ar; i++) {
-      if (mvals.at(INDEXc(i,j,ar,ac)) > mVectorBatch.at(j)) {
-	mVectorBatch.at(j) = mvals.at(INDEXc(i,j,ar,ac));
-      }
-    }
-  }
-
-  for (int j = 0; j < ac; j++) {
-    for (int i = 0; i < ar; i++) {
-      // if ( avals.at(INDEXc(i,j,ar,ac))<0.f )
-      // 	avals.at(INDEXc(i,j,ar,ac)) = 0.f;
-      avals.at(INDEXc(i,j,ar,ac)) = mvals.at(INDEXc(i,j,ar,ac)) - mVectorBatch.at(j);
-      avals.at(INDEXc(i,j,ar,ac)) = exp(avals.at(INDEXc(i,j,ar,ac)));
-      nB.at(j) += avals.at(INDEXc(i,j,ar,ac));
-    }
-  }
+/*
+ * Softmax of one sample, x and y can be the same.
+ * The maximum is subtracted before the exponential, against overflow;
+ * the result is clipped away from 0 and 1, for the log in the loss.
+ * Optionally also log y = x - log sum exp x, which stays finite
+ * where y itself would underflow.
+ * With wide vectors this reads the sample twice, see vsoftmax in vmath.h.
+ */
+static void softmax_sample
+    ( int n,const float *x,float *y,float *logy=nullptr,int approximation=0 ) {
+  vsoftmax( n,x,y,1e-7f,1-1e-7f,logy,approximation );
+}
 
-  for (int j = 0; j < ac; j++) {
-    for (int i = 0; i < ar; i++) {
-      avals.at(INDEXc(i,j,ar,ac)) = avals.at(INDEXc(i,j,ar,ac)) / nB.at(j);
-    }
-  }
+//template <typename VectorBatch>
+void softmax_io(const VectorBatch &m, VectorBatch &a, int approximation) {
+
+  shape_like( m,a );
+  const int ar = m.item_size(), ac = m.batch_size();
+  // every sample is normalized independently
+#pragma omp parallel for if(ar*ac>=parallel_threshold())
+  for (int j = 0; j < ac; j++)
+    softmax_sample( ar, m.data()+m.index(0,j), a.data()+a.index(0,j),
+		    nullptr,approximation );
+#ifdef DEBUG
+  m.display("Apply SoftMAX to");
+  a.display("giving");
+#endif
+}
 
-  for (int j=0; j < mvals.size(); j++) {
-    if (avals.at(j) <= 1e-7)
-      avals.at(j) = 1e-7;
-    if (avals.at(j) >= 1 - 1e-7)
-      avals.at(j) = 1 - 1e-7;
-  }
+void softmax_io(const VectorBatch &m, VectorBatch &a, VectorBatch &loga, int approximation) {
 
+  shape_like( m,a );
+  shape_like( m,loga );
+  const int ar = m.item_size(), ac = m.batch_size();
+#pragma omp parallel for if(ar*ac>=parallel_threshold())
+  for (int j = 0; j < ac; j++)
+    softmax_sample( ar, m.data()+m.index(0,j), a.data()+a.index(0,j),
+		    loga.data()+loga.index(0,j),approximation );
 #ifdef DEBUG
   m.display("Apply SoftMAX to");
   a.display("giving");
 #endif
 }
 
+void softmax_io(const Vector &m, Vector &a, int approximation) {
+
+  const int n = m.size();
+  assert( a.size()==n );
+  softmax_sample( n, m.data(), a.data(), nullptr,approximation );
+}
+
 //template <typename VectorBatch>
 void linear_io(const VectorBatch &m, VectorBatch &a) {
-    a.vals_vector().assign(m.vals_vector().begin(),m.vals_vector().end());
+  // in place there is nothing to do
+  if (&a==&m) return;
+  map_io( m,a,[] (float e) { return e; } );
+}
+
+void tanh_io(const VectorBatch &m, VectorBatch &a) {
+  map_blocks_io( m,a,vtanh );
+}
+
+void gelu_io(const VectorBatch &m, VectorBatch &a) {
+  map_blocks_io( m,a,vgelu );
+}
+
+void silu_io(const VectorBatch &m, VectorBatch &a) {
+  map_blocks_io( m,a,vsilu );
+}
+
+void elu_io(const VectorBatch &m, VectorBatch &a) {
+  map_blocks_io( m,a,velu );
 }
 
 //template <typename VectorBatch>
 void reluGrad_io(const VectorBatch &m, VectorBatch &a) {
-    a.vals_vector().assign(m.vals_vector().begin(),m.vals_vector().end());
-    float alpha = 0.01;
-    for ( auto &e : a.vals_vector()) {
-      if (e<=0)
-	e = alpha;
-      else
-	e = 1.0;
-    }
+  map_io( m,a,[] (float e) { return reluGrad_scalar(e); } );
 }
 
 //template <typename VectorBatch>
 void sigGrad_io(const VectorBatch &m, VectorBatch &a) {
-    assert( m.size()==a.size() );
-
-    const auto& mvals = m.vals_vector();
-    auto& avals = a.vals_vector();
-
-    avals.assign(mvals.begin(),mvals.end());
-    for ( auto &e : avals )
-      e = e * (1.0 - e);
+    map_io( m,a,[] (float e) { return sigGrad_scalar(e); } );
     if (trace_scalars())
       cout << "sigmoid grad " << m.normf() << " => " << a.normf() << "\n";
 }
 
-//template <typename VectorBatch>
-void smaxGrad_io(const VectorBatch &m, VectorBatch &a) {
-	assert( m.size()==a.size() );
-	/* Incomplete for now */
+/*
+ * The softmax derivative is not elementwise,
+ * so it does not fit the form of the other gradients:
+ * for every sample, the product of the softmax Jacobian
+ *   J = diag(s) - s s^t
+ * with a vector v, without forming J: J v = s .* ( v - <s,v> ).
+ * Two sweeps over the sample, O(n) instead of O(n^2).
+ * jv can be v itself.
+ */
+void smaxGrad_io(const VectorBatch &s, const VectorBatch &v, VectorBatch &jv) {
+  assert( v.item_size()==s.item_size() );
+  assert( v.batch_size()==s.batch_size() );
+  shape_like( v,jv );
+  const int n = s.item_size(), nb = s.batch_size();
+#pragma omp parallel for if(n*nb>=parallel_threshold())
+  for (int j = 0; j < nb; j++) {
+    const float *sj = s.data()+s.index(0,j), *vj = v.data()+v.index(0,j);
+    float *jvj = jv.data()+jv.index(0,j);
+    float sv{0.f};
+    for (int i = 0; i < n; i++)
+      sv += sj[i]*vj[i];
+    for (int i = 0; i < n; i++)
+      jvj[i] = sj[i]*( vj[i]-sv );
+  }
 }
 
+/*
+ * The dense Jacobian of one sample;
+ * this is only a check on the product above.
+ */
 #ifdef USE_GSL
 Matrix smaxGrad_vec( const gsl::span<float> &v)
 #else
@@ -206,10 +262,96 @@ Matrix smaxGrad_vec( const std::vector<float> &v)
 
 //template <typename VectorBatch>
 void linGrad_io(const VectorBatch &m, VectorBatch &a) {
-	assert( m.size()==a.size() );
+	shape_like( m,a );
 	std::fill(a.vals_vector().begin(), a.vals_vector().end(), 1.0); // gradient of a linear function
 }
 
+/*
+ * By value of the activation, for code that does not have it
+ * as a compile-time constant; the layers use the fused kernels instead.
+ */
+void apply_activation_io( acFunc f,const VectorBatch &i, VectorBatch &v, int approximation ) {
+  switch (f) {
+  case RELU : relu_io(i,v); break;
+  case SMAX : softmax_io(i,v,approximation); break;
+  case NONE : linear_io(i,v); break;
+  case SIG  :
+    // the traced one for the accurate exponential
+    if (approximation==0) { sigmoid_io(i,v); break; }
+    [[fallthrough]];
+  default :
+    with_elementwise_activation
+      ( f,[&] ( auto act ) {
+	using Act = decltype(act);
+	map_blocks_io
+	  ( i,v,[approximation] ( int n,const float *x,float *y ) {
+	    Act::array( n,x,y,approximation ); } );
+      } );
+  }
+}
+
+/*
+ * The elementwise activations do not care about the order of the elements,
+ * so for a feature-major batch this is the same sweep;
+ * a softmax goes by sample, and takes a sample-major batch.
+ */
+void apply_activation_io( acFunc f,const FeatureMajorBatch &i, FeatureMajorBatch &v, int approximation ) {
+  if (f==SMAX)
+    throw(std::string("softmax of a feature-major batch"));
+  with_elementwise_activation
+    ( f,[&] ( auto act ) {
+      using Act = decltype(act);
+      map_blocks_io
+	( i,v,[approximation] ( int n,const float *x,float *y ) {
+	  if constexpr (Act::linear)
+	    std::copy( x,x+n,y );
+	  else
+	    Act::array( n,x,y,approximation ); } );
+    } );
+}
+
+void activate_gradient_io( acFunc f,const VectorBatch &m, VectorBatch &a ) {
+  switch (f) {
+  case RELU : reluGrad_io(m,a); break;
+  case SIG  : sigGrad_io(m,a); break;
+  case NONE : linGrad_io(m,a); break;
+  default :
+    with_elementwise_activation
+      ( f,[&] ( auto act ) { map_blocks_io( m,a,decltype(act)::grad_array ); } );
+  }
+}
+
+float loss_error_io
+    ( lossfn l,const VectorBatch &result,const VectorBatch &labels,VectorBatch &error ) {
+  assert( labels.size()==result.size() );
+  shape_like( result,error );
+  float sum{0.f};
+  with_loss
+    ( l,[&] ( auto lossf ) {
+      sum = loss_and_error<decltype(lossf)>
+	( result.size(),result.data(),labels.data(),result.batch_size(),
+	  [] ( int ) { return 1.f; },error.data() );
+    } );
+  return sum;
+}
+
+float loss_error_io
+    ( lossfn l,const VectorBatch &result,const VectorBatch &labels,
+      const VectorBatch &dsigma,VectorBatch &error ) {
+  assert( labels.size()==result.size() );
+  assert( dsigma.size()==result.size() );
+  shape_like( result,error );
+  const float *d = dsigma.data();
+  float sum{0.f};
+  with_loss
+    ( l,[&] ( auto lossf ) {
+      sum = loss_and_error<decltype(lossf)>
+	( result.size(),result.data(),labels.data(),result.batch_size(),
+	  [d] ( int i ) { return d[i]; },error.data() );
+    } );
+  return sum;
+}
+
 // IM: Predefine templates so we can use them in separate .h and .item_size()pp files
 /*template void relu_io<VectorBatchector>(const VectorBatchector&, VectorBatchector&);
 template void relu_io<VectorBatchectorBatch>(const VectorBatchectorBatch&, VectorBatchectorBatch&);
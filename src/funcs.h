@@ -14,76 +14,281 @@
 #ifndef SRC_FUNCS_H
 #define SRC_FUNCS_H
 
-#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 
 #include "matrix.h"
 #include "vector.h"
 #include "vector2.h"
+#include "vmath.h"
+#include "parallel.h"
 
 #ifdef USE_GSL
 #include "gsl/gsl-lite.hpp"
 #endif
 
-enum acFunc{RELU,SIG,SMAX,NONE};
+// new ones go at the end: saveModel writes the number
+enum acFunc : int {RELU,SIG,SMAX,NONE,TANH,GELU,SILU,ELU};
 
+/*
+ * Single element versions of the elementwise activations,
+ * shared by the batch functions below and the fused kernels.
+ * The sigmoid uses the same polynomial exponential as the array kernels
+ * in vmath.h, so fused and separate activations agree to an ulp or so.
+ * It is kept away from 0 and 1, for the log in the loss function.
+ */
+// max( e,alpha e ) is the same for 0<=alpha<1, and it compiles to a max
+// instead of a branch: the sign of a layer output is not predictable
+inline float relu_scalar( float e ) {
+  const float alpha = 0.01; // used for leaky relu, for regular relu, set alpha to 0.0
+  return std::max( e,alpha*e );
+};
+constexpr float sigmoid_lo = 1.e-5f, sigmoid_hi = 1-1.e-5f;
+inline float sigmoid_scalar( float e ) {
+  e = 1.f / ( 1.f + exp_poly( -e ) );
+  if (e<sigmoid_lo) e = sigmoid_lo;
+  if (e>sigmoid_hi) e = sigmoid_hi;
+  return e;
+};
+inline float linear_scalar( float e ) { return e; };
+inline float tanh_scalar( float e ) { return tanh_poly(e); };
+inline float gelu_scalar( float e ) { return gelu_poly(e); };
+inline float silu_scalar( float e ) { return silu_poly(e); };
+inline float elu_scalar( float e ) { return elu_poly(e); };
+
+/*
+ * Derivatives, expressed in terms of the activated value
+ * so that they can be recomputed in the backward sweep.
+ * GELU and SiLU are not monotone, so their output does not determine
+ * the input: their derivatives take the input, see grad_of_input.
+ */
+inline float reluGrad_scalar( float a ) {
+  const float alpha = 0.01;
+  return ( a<=0 ? alpha : 1.f );
+};
+inline float sigGrad_scalar( float a ) { return a * ( 1.0 - a ); };
+inline float linGrad_scalar( float ) { return 1.f; };
+inline float tanhGrad_scalar( float a ) { return 1.f - a*a; };
+inline float eluGrad_scalar( float a ) { return elu_grad_poly(a); };
+inline float siluGrad_scalar( float x ) { return silu_grad_poly(x); };
+inline float geluGrad_scalar( float x ) { return gelu_grad_poly(x); };
+
+/*
+ * The elementwise activations as types, so that a kernel is instantiated
+ * once per activation with the scalar functions inlined in its loop;
+ * `array' and `grad_array' are the versions on n elements, in place allowed,
+ * vectorized in vmath.h where there is an exponential;
+ * `array' also takes the degree of that exponential, see with_exp_degree.
+ * with_elementwise_activation( f,op ) calls op( activation<F>() )
+ * for the F that is the value of f; this is the one switch on acFunc,
+ * the kernels are generic lambdas or templates on the activation.
+ * Softmax is not elementwise: it gets the linear one, as in the fused products.
+ */
+template< acFunc F > struct activation;
+template<> struct activation<RELU> {
+  static constexpr bool linear = false, grad_of_input = false;
+  static float value( float e ) { return relu_scalar(e); };
+  static void array( int n,const float *x,float *y,int /* approximation */ ) {
+    for (int i=0; i<n; i++) y[i] = relu_scalar(x[i]); };
+  static float grad( float a ) { return reluGrad_scalar(a); };
+  static void grad_array( int n,const float *a,float *g ) {
+    for (int i=0; i<n; i++) g[i] = reluGrad_scalar(a[i]); };
+};
+template<> struct activation<SIG> {
+  static constexpr bool linear = false, grad_of_input = false;
+  static float value( float e ) { return sigmoid_scalar(e); };
+  static void array( int n,const float *x,float *y,int approximation ) {
+    vsigmoid( n,x,y,sigmoid_lo,sigmoid_hi,approximation ); };
+  static float grad( float a ) { return sigGrad_scalar(a); };
+  static void grad_array( int n,const float *a,float *g ) {
+    for (int i=0; i<n; i++) g[i] = sigGrad_scalar(a[i]); };
+};
+template<> struct activation<NONE> {
+  static constexpr bool linear = true, grad_of_input = false;
+  static float value( float e ) { return linear_scalar(e); };
+  static void array( int n,const float *x,float *y,int /* approximation */ ) {
+    if (x!=y) std::copy( x,x+n,y ); };
+  static float grad( float a ) { return linGrad_scalar(a); };
+  static void grad_array( int n,const float *,float *g ) {
+    std::fill( g,g+n,1.f ); };
+};
+template<> struct activation<TANH> {
+  static constexpr bool linear = false, grad_of_input = false;
+  static float value( float e ) { return tanh_scalar(e); };
+  static void array( int n,const float *x,float *y,int /* approximation */ ) {
+    vtanh( n,x,y ); };
+  static float grad( float a ) { return tanhGrad_scalar(a); };
+  static void grad_array( int n,const float *a,float *g ) {
+    for (int i=0; i<n; i++) g[i] = tanhGrad_scalar(a[i]); };
+};
+template<> struct activation<ELU> {
+  static constexpr bool linear = false, grad_of_input = false;
+  static float value( float e ) { return elu_scalar(e); };
+  static void array( int n,const float *x,float *y,int /* approximation */ ) {
+    velu( n,x,y ); };
+  static float grad( float a ) { return eluGrad_scalar(a); };
+  static void grad_array( int n,const float *a,float *g ) { velu_grad( n,a,g ); };
+};
+template<> struct activation<GELU> {
+  static constexpr bool linear = false, grad_of_input = true;
+  static float value( float e ) { return gelu_scalar(e); };
+  static void array( int n,const float *x,float *y,int /* approximation */ ) {
+    vgelu( n,x,y ); };
+  static float grad( float x ) { return geluGrad_scalar(x); };
+  static void grad_array( int n,const float *x,float *g ) { vgelu_grad( n,x,g ); };
+};
+template<> struct activation<SILU> {
+  static constexpr bool linear = false, grad_of_input = true;
+  static float value( float e ) { return silu_scalar(e); };
+  static void array( int n,const float *x,float *y,int /* approximation */ ) {
+    vsilu( n,x,y ); };
+  static float grad( float x ) { return siluGrad_scalar(x); };
+  static void grad_array( int n,const float *x,float *g ) { vsilu_grad( n,x,g ); };
+};
+
+template< typename Op >
+inline void with_elementwise_activation( acFunc f,Op &&op ) {
+  switch (f) {
+  case RELU : op( activation<RELU>() ); break;
+  case SIG  : op( activation<SIG>()  ); break;
+  case TANH : op( activation<TANH>() ); break;
+  case GELU : op( activation<GELU>() ); break;
+  case SILU : op( activation<SILU>() ); break;
+  case ELU  : op( activation<ELU>()  ); break;
+  default   : op( activation<NONE>() );
+  }
+};
+
+//! is the derivative of f a function of its input, rather than its output?
+inline bool grad_of_input( acFunc f ) {
+  bool g{false};
+  with_elementwise_activation
+    ( f,[&g] ( auto act ) { g = decltype(act)::grad_of_input; } );
+  return g;
+};
+
+/*
+ * Activations and their derivatives on a whole batch.
+ * Out of place, f_io( in,out ): out gets the shape of in, and out = f( in );
+ * out can be in itself. In place, f_inplace( v ): v = f( v ).
+ * The elementwise ones are a single loop
+ * that reads each element once and writes it once.
+ * The layers apply their activation in place,
+ * so a custom activation has to allow in and out to be the same object.
+ * The softmax takes the degree of its exponential,
+ * see with_exp_degree in vmath.h; by default the accurate one.
+ * sigmoid_io keeps the form of a custom activation, see Net::addLayer:
+ * the approximate sigmoid goes through apply_activation_io.
+ */
 //template <typename VectorBatch>
 void relu_io    (const VectorBatch &i, VectorBatch &v);
 //template <typename VectorBatch>
 void sigmoid_io (const VectorBatch &i, VectorBatch &v);
 //template <typename VectorBatch>
-void softmax_io (const VectorBatch &i, VectorBatch &v);
+void softmax_io (const VectorBatch &i, VectorBatch &v, int approximation=0);
+// also the log of the softmax, i - log sum exp i, for the cross entropy
+void softmax_io (const VectorBatch &i, VectorBatch &v, VectorBatch &logv, int approximation=0);
 //template <typename VectorBatch>
 void linear_io    (const VectorBatch &i, VectorBatch &v);
+void tanh_io    (const VectorBatch &i, VectorBatch &v);
+void gelu_io    (const VectorBatch &i, VectorBatch &v);
+void silu_io    (const VectorBatch &i, VectorBatch &v);
+void elu_io     (const VectorBatch &i, VectorBatch &v);
+// single sample, for inference; i and v can be the same
+void softmax_io (const Vector &i, Vector &v, int approximation=0);
+
+inline void relu_inplace    ( VectorBatch &v ) { relu_io(v,v); };
+inline void sigmoid_inplace ( VectorBatch &v ) { sigmoid_io(v,v); };
+inline void softmax_inplace ( VectorBatch &v,int approximation=0 ) {
+  softmax_io(v,v,approximation); };
+inline void linear_inplace  ( VectorBatch & ) {};
+inline void softmax_inplace ( Vector &v,int approximation=0 ) {
+  softmax_io(v,v,approximation); };
 
 //template <typename VectorBatch>
 void reluGrad_io(const VectorBatch &m, VectorBatch &a);
 //template <typename VectorBatch>
 void sigGrad_io (const VectorBatch &m, VectorBatch &a);
-//template <typename VectorBatch>
-void smaxGrad_io(const VectorBatch &m, VectorBatch &a);
+// jv = J v for every sample, with J the Jacobian of the softmax output s;
+// the softmax has no elementwise derivative
+void smaxGrad_io(const VectorBatch &s, const VectorBatch &v, VectorBatch &jv);
 //template <typename VectorBatch>
 void linGrad_io	(const VectorBatch &m, VectorBatch &a);
 
+// the built-in activation f, and its derivative, by value;
+// the derivative takes the input of f where grad_of_input(f),
+// and SMAX is treated as NONE, as in the fused products: see smaxGrad_io
+void apply_activation_io    ( acFunc f,const VectorBatch &i, VectorBatch &v,
+			      int approximation=0 );
+// the same for a hidden layer with feature-major batches: not SMAX
+void apply_activation_io    ( acFunc f,const FeatureMajorBatch &i, FeatureMajorBatch &v,
+			      int approximation=0 );
+void activate_gradient_io   ( acFunc f,const VectorBatch &m, VectorBatch &a );
+
 #ifdef USE_GSL
 Matrix smaxGrad_vec( const gsl::span<float> &v);
 #else
 Matrix smaxGrad_vec( const std::vector<float> &v);
 #endif
 
-template <typename V>
-static inline std::vector< std::function< void(const V&, V&) > > apply_activation{
-  [] ( const V &v, V &a ) { relu_io(v,a); },
-    [] ( const V &v, V &a ) { sigmoid_io(v,a); },
-    [] ( const V &v, V &a ) { softmax_io(v,a); },
-    [] ( const V &v, V &a ) { linear_io(v,a); }
+enum lossfn{cce, mse}; // categorical cross entropy, mean squared error
+
+/*
+ * The loss of one element, and its derivative with respect to the result;
+ * dispatched like the activations.
+ */
+template< lossfn L > struct loss;
+template<> struct loss<cce> {
+  // one-hot labels: no log for the zeros
+  static float value( float gT,float result ) {
+    assert(result>0.f);
+    return ( gT==0.f ? 0.f : -gT * std::log(result) ); };
+  static float derivative( float gT,float result ) {
+    return ( gT==0.f ? 0.f : -gT / result ); };
 };
-  	
-template <typename V>
-static inline std::vector< std::function< void(const V&, V&) > > activate_gradient{
-  [] (  const V &m, V &v ) { reluGrad_io(m,v); },
-    [] (  const V &m, V &v ) { sigGrad_io(m,v); },
-    [] (  const V &m, V &v ) { smaxGrad_io(m,v); },
-    [] (  const V &m, V &v ) { linGrad_io(m,v); }
+template<> struct loss<mse> {
+  static float value( float gT,float result ) {
+    const float d = gT-result; return d*d; };
+  static float derivative( float gT,float result ) {
+    return 2.f * ( result-gT ); };
 };
 
-enum lossfn{cce, mse}; // categorical cross entropy, mean squared error
-inline static std::vector< std::function< float( const float& groundTruth, const float& result) > > lossFunctions{
-  [] ( const float &gT, const float &result ) {
-    assert(result>0.f);
-    return gT * log(result); }, // Categorical Cross Entropy
-  [] ( const float &gT, const float &result ) {
-    return pow(gT - result, 2); }, // Mean Squared Error
+template< typename Op >
+inline void with_loss( lossfn l,Op &&op ) {
+  switch (l) {
+  case cce : op( loss<cce>() ); break;
+  default  : op( loss<mse>() );
+  }
 };
 
-inline static std::vector< std::function< VectorBatch( VectorBatch&, VectorBatch&) > > d_lossFunctions  {
-  [] ( VectorBatch &gT, VectorBatch &result ) -> VectorBatch {
-    std::cout << "Ambiguous operator\n" ; throw(27);
-    //return -gT / ( result/ static_cast<float>( result.batch_size() ) );
-  },
-  [] ( VectorBatch &gT, VectorBatch &result ) -> VectorBatch {
-    std::cout << "Ambiguous operator\n" ; throw(27);
-    //return -2 * ( gT-result)/ static_cast<float>( result.batch_size() );
-  },
+/*
+ * The loss of a batch and the error of its outputs, in one sweep:
+ * returns the loss summed over the n elements,
+ * and sets e[i] = L'( r[i] )*bs * grad(i), the delta of the output layer,
+ * with L' the derivative of the loss and grad(i) that of the activation
+ * at element i. It is scaled by bs as the rest of the backprop;
+ * the optimizers divide by the batch size.
+ * A softmax with the cross entropy does not come here: see Layer::set_topdelta.
+ * The elements are independent, so e can be r.
+ */
+template< typename Loss,typename Grad >
+inline float loss_and_error
+    ( int n,const float *r,const float *g,int bs,Grad &&grad,float *e ) {
+  float sum{0.f};
+#pragma omp parallel for reduction(+:sum) if(n>=parallel_threshold())
+  for (int i=0; i<n; i++) {
+    const float ri = r[i], gi = g[i];
+    sum += Loss::value( gi,ri );
+    e[i] = Loss::derivative( gi,ri )*bs * grad(i);
+  }
+  return sum;
 };
+// the same on batches: error = the loss derivative, times dsigma if given
+float loss_error_io
+    ( lossfn l,const VectorBatch &result,const VectorBatch &labels,VectorBatch &error );
+float loss_error_io
+    ( lossfn l,const VectorBatch &result,const VectorBatch &labels,
+      const VectorBatch &dsigma,VectorBatch &error );
 
 #endif //SRC_FUNCS_H
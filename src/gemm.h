@@ -0,0 +1,85 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_GEMM_H
+#define SRC_GEMM_H
+
+#include "funcs.h"
+
+/*
+ * Matrix-matrix product in the style of the BLIS typed API:
+ *   C <- alpha A B + beta C
+ * with A m x k, B k x n, C m x n.
+ * Every operand is described by a row stride and a column stride,
+ * so element (i,j) of X is X[ i*rsx + j*csx ].
+ * This covers row storage, column storage, and transposes thereof.
+ */
+void gemm_reference
+    ( int m,int n,int k,
+      float alpha,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float beta,
+      float *c,int rsc,int csc );
+
+/*
+ * Same, with hand-vectorized micro kernels;
+ * the instruction set is chosen at run time, see simd.h
+ */
+void gemm_simd
+    ( int m,int n,int k,
+      float alpha,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float beta,
+      float *c,int rsc,int csc );
+
+/*
+ * Fused forward product: C <- act( AB + bias 1^t ).
+ * The bias is indexed by row, the activation is elementwise;
+ * for SMAX only the bias is added and softmax is left to the caller.
+ * The sigmoid uses the exponential of degree approximation, see vmath.h.
+ */
+void gemm_reference_bias_act
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *bias,acFunc f,int approximation );
+void gemm_simd_bias_act
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *bias,acFunc f,int approximation );
+
+/*
+ * Fused backward product: C <- AB .* act'( Act ),
+ * with the derivative computed from the activated values Act,
+ * which are stored with the same strides as C.
+ * SMAX is not elementwise, and gets treated as NONE.
+ */
+void gemm_reference_act_grad
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *act,acFunc f );
+void gemm_simd_act_grad
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *act,acFunc f );
+
+#endif //SRC_GEMM_H
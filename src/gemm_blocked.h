@@ -0,0 +1,282 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_GEMM_BLOCKED_H
+#define SRC_GEMM_BLOCKED_H
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "parallel.h"
+#include "funcs.h"
+
+/*
+ * Blocked matrix-matrix product, following the Goto/BLIS scheme:
+ * - the k dimension is cut in KC slabs,
+ *   and the B slab is packed so that it stays in L2/L3 cache;
+ * - the m dimension is cut in MC blocks,
+ *   and the A block is packed so that it stays in L2 cache;
+ * - a micro kernel computes an MR x NR block of C in registers,
+ *   streaming packed slivers of A and B out of L1 cache.
+ *
+ * Packed A consists of MR-row slivers, each stored k-major: a[p*MR+i].
+ * Packed B consists of NR-column slivers, each stored k-major: b[p*NR+j].
+ * Slivers at the matrix edge are padded with zeros,
+ * so the micro kernel never needs to test bounds.
+ *
+ * The micro kernel has the signature
+ *   void kernel( int kc,const float *ap,const float *bp,float *ab )
+ * and stores the MR x NR product column-major in ab.
+ * This header is shared by the reference and SIMD implementations,
+ * which differ only in the tile sizes and the micro kernel.
+ *
+ * An optional epilogue is applied to every element of C
+ * in its final update, that is, while the micro tile is still in L1.
+ * It gets the row and column index of the element,
+ * so that it can add a bias per output feature,
+ * or multiply by the activation derivative of the same element.
+ * An epilogue with `on_tile' instead gets the whole micro tile at once,
+ * so that it can use a vectorized kernel on it.
+ *
+ * With OpenMP the NR-column slivers of C are divided over the threads:
+ * for the network these are the batch columns.
+ * Packing is done by the master thread.
+ */
+
+namespace gemm_blocked_detail {
+
+  static constexpr int MC = 128, KC = 256, NC = 3072;
+
+  template< int MR >
+  void pack_a( int mc,int kc,const float *a,int rsa,int csa,float *ap ) {
+    for (int i0=0; i0<mc; i0+=MR) {
+      const int ib = std::min(MR,mc-i0);
+      for (int p=0; p<kc; p++) {
+	const float *ak = a + i0*rsa + p*csa;
+	int i=0;
+	for ( ; i<ib; i++)
+	  ap[i] = ak[i*rsa];
+	for ( ; i<MR; i++)
+	  ap[i] = 0.f;
+	ap += MR;
+      }
+    }
+  }
+
+  template< int NR >
+  void pack_b( int kc,int nc,const float *b,int rsb,int csb,float *bp ) {
+    for (int j0=0; j0<nc; j0+=NR) {
+      const int jb = std::min(NR,nc-j0);
+      for (int p=0; p<kc; p++) {
+	const float *bk = b + p*rsb + j0*csb;
+	int j=0;
+	for ( ; j<jb; j++)
+	  bp[j] = bk[j*csb];
+	for ( ; j<NR; j++)
+	  bp[j] = 0.f;
+	bp += NR;
+      }
+    }
+  }
+
+  /*
+   * C <- epilogue( alpha AB + beta C ) on an mr x nr corner of the micro tile;
+   * (i0,j0) is the index of the first element of the tile in C.
+   * A tile epilogue works in ab, which is MR x nr,
+   * where the rows beyond mr are zero.
+   */
+  template< int MR,int NR,typename Epilogue >
+  inline void update_c
+      ( int mr,int nr,float alpha,float *ab,float beta,
+	float *c,int rsc,int csc,int i0,int j0,const Epilogue &epilogue ) {
+    if constexpr (Epilogue::on_tile) {
+      for (int j=0; j<nr; j++)
+	for (int i=0; i<mr; i++)
+	  ab[ i+j*MR ] = alpha * ab[ i+j*MR ]
+	    + ( beta==0.f ? 0.f : beta * c[ i*rsc+j*csc ] );
+      epilogue.template tile<MR,NR>( mr,nr,i0,j0,ab );
+      for (int j=0; j<nr; j++)
+	for (int i=0; i<mr; i++)
+	  c[ i*rsc+j*csc ] = ab[ i+j*MR ];
+    } else if (beta==0.f) {
+      for (int j=0; j<nr; j++)
+	for (int i=0; i<mr; i++)
+	  c[ i*rsc+j*csc ] = epilogue( i0+i,j0+j, alpha * ab[ i+j*MR ] );
+    } else {
+      for (int j=0; j<nr; j++)
+	for (int i=0; i<mr; i++)
+	  c[ i*rsc+j*csc ] = epilogue( i0+i,j0+j, alpha * ab[ i+j*MR ] + beta * c[ i*rsc+j*csc ] );
+    }
+  }
+
+}
+
+struct gemm_no_epilogue {
+  static constexpr bool on_tile = false;
+  float operator()( int,int,float v ) const { return v; };
+};
+
+/*
+ * add bias_i to row i, then apply an elementwise activation, see funcs.h;
+ * the activation goes over the whole tile with its array kernel,
+ * with the exponential of degree `approximation'
+ */
+template< typename Act >
+struct gemm_bias_activation {
+  static constexpr bool on_tile = true;
+  const float *bias; int approximation;
+  float operator()( int i,int,float v ) const {
+    return Act::value( v+bias[i] );
+  };
+  template< int MR,int NR >
+  void tile( int mr,int nr,int i0,int,float *ab ) const {
+    for (int j=0; j<nr; j++)
+      for (int i=0; i<mr; i++)
+	ab[ i+j*MR ] += bias[ i0+i ];
+    if constexpr (not Act::linear)
+      Act::array( MR*nr,ab,ab,approximation );
+  };
+};
+
+/*
+ * multiply by the activation derivative,
+ * computed from the activated value with the same index as C;
+ * the tile of those is gathered, and the derivative taken with the array kernel
+ */
+template< typename Act >
+struct gemm_activation_gradient {
+  static constexpr bool on_tile = true;
+  const float *act; int rsact,csact;
+  float operator()( int i,int j,float v ) const {
+    return v * Act::grad( act[ i*rsact+j*csact ] );
+  };
+  template< int MR,int NR >
+  void tile( int mr,int nr,int i0,int j0,float *ab ) const {
+    alignas(64) float g[MR*NR];
+    for (int j=0; j<nr; j++) {
+      const float *aj = act + i0*rsact + (j0+j)*csact;
+      int i=0;
+      for ( ; i<mr; i++)
+	g[ i+j*MR ] = aj[ i*rsact ];
+      for ( ; i<MR; i++)
+	g[ i+j*MR ] = 0.f;
+    }
+    Act::grad_array( MR*nr,g,g );
+    for (int j=0; j<nr; j++)
+      for (int i=0; i<mr; i++)
+	ab[ i+j*MR ] *= g[ i+j*MR ];
+  };
+};
+
+template< int MR,int NR,void (*kernel)(int,const float*,const float*,float*),
+	  typename Epilogue=gemm_no_epilogue >
+void gemm_blocked
+    ( int m,int n,int k,
+      float alpha,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float beta,
+      float *c,int rsc,int csc,
+      const Epilogue &epilogue=Epilogue() ) {
+  using namespace gemm_blocked_detail;
+  assert( m>=0 and n>=0 and k>=0 );
+  if (m==0 or n==0) return;
+  if (k==0 or alpha==0.f) {
+    for (int j=0; j<n; j++)
+      for (int i=0; i<m; i++)
+	c[ i*rsc+j*csc ] = epilogue( i,j, ( beta==0.f ? 0.f : beta * c[ i*rsc+j*csc ] ) );
+    return;
+  }
+
+  // packing buffers are kept around between calls
+  static thread_local std::vector<float> apack, bpack;
+  const int
+    mcmax = std::min(MC,m), kcmax = std::min(KC,k), ncmax = std::min(NC,n);
+  apack.resize( ( (mcmax+MR-1)/MR ) * MR * kcmax );
+  bpack.resize( ( (ncmax+NR-1)/NR ) * NR * kcmax );
+  // the buffers are thread local, so threads get plain pointers to them
+  const float *ablock = apack.data(), *bblock = bpack.data();
+  const bool parallel = m*n>=parallel_threshold();
+
+  for (int jc=0; jc<n; jc+=NC) {
+    const int nc = std::min(NC,n-jc);
+    for (int pc=0; pc<k; pc+=KC) {
+      const int kc = std::min(KC,k-pc);
+      // only the first slab of k sees the original C,
+      // only the last one applies the epilogue
+      const float betac = ( pc==0 ? beta : 1.f );
+      const bool last = pc+kc==k;
+      pack_b<NR>( kc,nc, b+pc*rsb+jc*csb,rsb,csb, bpack.data() );
+      for (int ic=0; ic<m; ic+=MC) {
+	const int mc = std::min(MC,m-ic);
+	pack_a<MR>( mc,kc, a+ic*rsa+pc*csa,rsa,csa, apack.data() );
+#pragma omp parallel for if(parallel)
+	for (int jr=0; jr<nc; jr+=NR) {
+	  alignas(64) float ab[MR*NR];
+	  const int nr = std::min(NR,nc-jr);
+	  const float *bp = bblock + jr*kc;
+	  for (int ir=0; ir<mc; ir+=MR) {
+	    const int mr = std::min(MR,mc-ir);
+	    const float *ap = ablock + ir*kc;
+	    kernel( kc,ap,bp,ab );
+	    float *cp = c+(ic+ir)*rsc+(jc+jr)*csc;
+	    if (last)
+	      update_c<MR,NR>( mr,nr,alpha,ab,betac, cp,rsc,csc, ic+ir,jc+jr,epilogue );
+	    else
+	      update_c<MR,NR>( mr,nr,alpha,ab,betac, cp,rsc,csc, ic+ir,jc+jr,gemm_no_epilogue() );
+	  }
+	}
+      }
+    }
+  }
+}
+
+/*
+ * C <- act( AB + bias ) for the elementwise activations;
+ * softmax is not elementwise, so it gets only the bias here.
+ */
+template< int MR,int NR,void (*kernel)(int,const float*,const float*,float*) >
+void gemm_blocked_bias_act
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *bias,acFunc f,int approximation ) {
+  with_elementwise_activation
+    ( f,[&] ( auto act ) {
+      gemm_blocked<MR,NR,kernel>
+	( m,n,k, 1.f, a,rsa,csa, b,rsb,csb, 0.f, c,rsc,csc,
+	  gemm_bias_activation<decltype(act)>{bias,approximation} );
+    } );
+}
+
+/*
+ * C <- (AB) .* act'(act) for the elementwise activations,
+ * where act is stored with the same strides as C
+ */
+template< int MR,int NR,void (*kernel)(int,const float*,const float*,float*) >
+void gemm_blocked_act_grad
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *act,acFunc f ) {
+  with_elementwise_activation
+    ( f,[&] ( auto actf ) {
+      gemm_blocked<MR,NR,kernel>
+	( m,n,k, 1.f, a,rsa,csa, b,rsb,csb, 0.f, c,rsc,csc,
+	  gemm_activation_gradient<decltype(actf)>{act,rsc,csc} );
+    } );
+}
+
+#endif //SRC_GEMM_BLOCKED_H
@@ -0,0 +1,71 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "gemm.h"
+#include "gemm_blocked.h"
+
+/*
+ * Portable micro kernel: ab = A sliver times B sliver.
+ * The accumulator is kept column-major so that the inner loop
+ * over the MR rows is a contiguous fused multiply-add
+ * that the compiler turns into vector instructions.
+ */
+static constexpr int MR = 8, NR = 6;
+
+static void micro_kernel
+    ( int kc,const float * __restrict__ ap,const float * __restrict__ bp,
+      float * __restrict__ ab ) {
+  float acc[NR][MR] = {};
+  for (int p=0; p<kc; p++) {
+    for (int j=0; j<NR; j++) {
+      const float bj = bp[j];
+      for (int i=0; i<MR; i++)
+	acc[j][i] += ap[i] * bj;
+    }
+    ap += MR; bp += NR;
+  }
+  for (int j=0; j<NR; j++)
+    for (int i=0; i<MR; i++)
+      ab[ i+j*MR ] = acc[j][i];
+}
+
+void gemm_reference
+    ( int m,int n,int k,
+      float alpha,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float beta,
+      float *c,int rsc,int csc ) {
+  gemm_blocked<MR,NR,micro_kernel>
+    ( m,n,k, alpha, a,rsa,csa, b,rsb,csb, beta, c,rsc,csc );
+}
+
+void gemm_reference_bias_act
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *bias,acFunc f,int approximation ) {
+  gemm_blocked_bias_act<MR,NR,micro_kernel>
+    ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, bias,f,approximation );
+}
+
+void gemm_reference_act_grad
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *act,acFunc f ) {
+  gemm_blocked_act_grad<MR,NR,micro_kernel>
+    ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, act,f );
+}
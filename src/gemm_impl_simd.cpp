@@ -0,0 +1,191 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "gemm.h"
+#include "gemm_blocked.h"
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#define TARGET_AVX2   __attribute__((target("avx2,fma")))
+#endif
+
+/*
+ * Micro kernels: ab = A sliver times B sliver, ab stored column-major.
+ * Each kernel keeps NR columns of two vector registers in accumulators,
+ * so the tile height MR is two register widths:
+ * AVX-512 32x12, AVX2 16x6, SSE 8x6.
+ * The generic kernel is the same as the reference one,
+ * left to the compiler to vectorize.
+ */
+
+static constexpr int MRgen = 8, NRgen = 6;
+static void kernel_generic
+    ( int kc,const float * __restrict__ ap,const float * __restrict__ bp,
+      float * __restrict__ ab ) {
+  float acc[NRgen][MRgen] = {};
+  for (int p=0; p<kc; p++) {
+    for (int j=0; j<NRgen; j++)
+      for (int i=0; i<MRgen; i++)
+	acc[j][i] += ap[i] * bp[j];
+    ap += MRgen; bp += NRgen;
+  }
+  for (int j=0; j<NRgen; j++)
+    for (int i=0; i<MRgen; i++)
+      ab[ i+j*MRgen ] = acc[j][i];
+}
+
+#ifdef SIMD_X86
+
+static constexpr int MR512 = 32, NR512 = 12;
+TARGET_AVX512 static void kernel_avx512
+    ( int kc,const float * __restrict__ ap,const float * __restrict__ bp,
+      float * __restrict__ ab ) {
+  __m512 c[NR512][2];
+  for (int j=0; j<NR512; j++)
+    c[j][0] = c[j][1] = _mm512_setzero_ps();
+  for (int p=0; p<kc; p++) {
+    const __m512 a0 = _mm512_loadu_ps(ap), a1 = _mm512_loadu_ps(ap+16);
+    for (int j=0; j<NR512; j++) {
+      const __m512 bj = _mm512_set1_ps(bp[j]);
+      c[j][0] = _mm512_fmadd_ps( a0,bj,c[j][0] );
+      c[j][1] = _mm512_fmadd_ps( a1,bj,c[j][1] );
+    }
+    ap += MR512; bp += NR512;
+  }
+  for (int j=0; j<NR512; j++) {
+    _mm512_storeu_ps( ab+j*MR512,    c[j][0] );
+    _mm512_storeu_ps( ab+j*MR512+16, c[j][1] );
+  }
+}
+
+static constexpr int MR256 = 16, NR256 = 6;
+TARGET_AVX2 static void kernel_avx2
+    ( int kc,const float * __restrict__ ap,const float * __restrict__ bp,
+      float * __restrict__ ab ) {
+  __m256 c[NR256][2];
+  for (int j=0; j<NR256; j++)
+    c[j][0] = c[j][1] = _mm256_setzero_ps();
+  for (int p=0; p<kc; p++) {
+    const __m256 a0 = _mm256_loadu_ps(ap), a1 = _mm256_loadu_ps(ap+8);
+    for (int j=0; j<NR256; j++) {
+      const __m256 bj = _mm256_broadcast_ss(bp+j);
+      c[j][0] = _mm256_fmadd_ps( a0,bj,c[j][0] );
+      c[j][1] = _mm256_fmadd_ps( a1,bj,c[j][1] );
+    }
+    ap += MR256; bp += NR256;
+  }
+  for (int j=0; j<NR256; j++) {
+    _mm256_storeu_ps( ab+j*MR256,   c[j][0] );
+    _mm256_storeu_ps( ab+j*MR256+8, c[j][1] );
+  }
+}
+
+static constexpr int MR128 = 8, NR128 = 6;
+static void kernel_sse
+    ( int kc,const float * __restrict__ ap,const float * __restrict__ bp,
+      float * __restrict__ ab ) {
+  __m128 c[NR128][2];
+  for (int j=0; j<NR128; j++)
+    c[j][0] = c[j][1] = _mm_setzero_ps();
+  for (int p=0; p<kc; p++) {
+    const __m128 a0 = _mm_loadu_ps(ap), a1 = _mm_loadu_ps(ap+4);
+    for (int j=0; j<NR128; j++) {
+      const __m128 bj = _mm_set1_ps(bp[j]);
+      c[j][0] = _mm_add_ps( c[j][0],_mm_mul_ps(a0,bj) );
+      c[j][1] = _mm_add_ps( c[j][1],_mm_mul_ps(a1,bj) );
+    }
+    ap += MR128; bp += NR128;
+  }
+  for (int j=0; j<NR128; j++) {
+    _mm_storeu_ps( ab+j*MR128,   c[j][0] );
+    _mm_storeu_ps( ab+j*MR128+4, c[j][1] );
+  }
+}
+
+#endif // SIMD_X86
+
+void gemm_simd
+    ( int m,int n,int k,
+      float alpha,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float beta,
+      float *c,int rsc,int csc ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 :
+    gemm_blocked<MR512,NR512,kernel_avx512>
+      ( m,n,k, alpha, a,rsa,csa, b,rsb,csb, beta, c,rsc,csc ); break;
+  case simd_isa::avx2 :
+    gemm_blocked<MR256,NR256,kernel_avx2>
+      ( m,n,k, alpha, a,rsa,csa, b,rsb,csb, beta, c,rsc,csc ); break;
+  case simd_isa::sse :
+    gemm_blocked<MR128,NR128,kernel_sse>
+      ( m,n,k, alpha, a,rsa,csa, b,rsb,csb, beta, c,rsc,csc ); break;
+#endif
+  default :
+    gemm_blocked<MRgen,NRgen,kernel_generic>
+      ( m,n,k, alpha, a,rsa,csa, b,rsb,csb, beta, c,rsc,csc );
+  }
+}
+
+void gemm_simd_bias_act
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *bias,acFunc f,int approximation ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 :
+    gemm_blocked_bias_act<MR512,NR512,kernel_avx512>
+      ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, bias,f,approximation ); break;
+  case simd_isa::avx2 :
+    gemm_blocked_bias_act<MR256,NR256,kernel_avx2>
+      ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, bias,f,approximation ); break;
+  case simd_isa::sse :
+    gemm_blocked_bias_act<MR128,NR128,kernel_sse>
+      ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, bias,f,approximation ); break;
+#endif
+  default :
+    gemm_blocked_bias_act<MRgen,NRgen,kernel_generic>
+      ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, bias,f,approximation );
+  }
+}
+
+void gemm_simd_act_grad
+    ( int m,int n,int k,
+      const float *a,int rsa,int csa,
+      const float *b,int rsb,int csb,
+      float *c,int rsc,int csc,
+      const float *act,acFunc f ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 :
+    gemm_blocked_act_grad<MR512,NR512,kernel_avx512>
+      ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, act,f ); break;
+  case simd_isa::avx2 :
+    gemm_blocked_act_grad<MR256,NR256,kernel_avx2>
+      ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, act,f ); break;
+  case simd_isa::sse :
+    gemm_blocked_act_grad<MR128,NR128,kernel_sse>
+      ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, act,f ); break;
+#endif
+  default :
+    gemm_blocked_act_grad<MRgen,NRgen,kernel_generic>
+      ( m,n,k, a,rsa,csa, b,rsb,csb, c,rsc,csc, act,f );
+  }
+}
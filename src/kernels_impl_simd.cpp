@@ -0,0 +1,264 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "simd.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+using std::string;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#define TARGET_AVX2   __attribute__((target("avx2,fma")))
+#endif
+
+/*
+ * Processor detection
+ */
+static simd_isa detect_simd() {
+  simd_isa isa{simd_isa::generic};
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    isa = simd_isa::avx512;
+  else if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+    isa = simd_isa::avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    isa = simd_isa::sse;
+#endif
+  // user can ask for a lower level
+  if (const char *env = std::getenv("EDUDL_SIMD")) {
+    for ( auto lower : { simd_isa::generic,simd_isa::sse,simd_isa::avx2 } )
+      if ( string(env)==simd_name(lower) and lower<isa )
+	isa = lower;
+  }
+  return isa;
+}
+
+simd_isa simd_level() {
+  static const simd_isa isa = detect_simd();
+  return isa;
+}
+
+const char *simd_name( simd_isa isa ) {
+  switch (isa) {
+  case simd_isa::avx512 : return "avx512";
+  case simd_isa::avx2   : return "avx2";
+  case simd_isa::sse    : return "sse";
+  default               : return "generic";
+  }
+}
+
+/*
+ * Generic versions, also used for the remainder loops
+ */
+static void saxpy_generic( int n,float a,const float *x,float *y ) {
+  for (int i=0; i<n; i++)
+    y[i] += a*x[i];
+}
+static void sscal2_generic( int n,float a,const float *x,float *y ) {
+  for (int i=0; i<n; i++)
+    y[i] = a*x[i];
+}
+static float sdot_generic( int n,const float *x,const float *y ) {
+  float s{0.f};
+  for (int i=0; i<n; i++)
+    s += x[i]*y[i];
+  return s;
+}
+
+#ifdef SIMD_X86
+
+/*
+ * AVX-512: 16 floats per register, masked remainders
+ */
+TARGET_AVX512 static void saxpy_avx512( int n,float a,const float *x,float *y ) {
+  const __m512 va = _mm512_set1_ps(a);
+  int i=0;
+  for ( ; i+16<=n; i+=16)
+    _mm512_storeu_ps( y+i, _mm512_fmadd_ps( va,_mm512_loadu_ps(x+i),_mm512_loadu_ps(y+i) ) );
+  if (i<n) {
+    const __mmask16 m = (1U<<(n-i))-1;
+    _mm512_mask_storeu_ps
+      ( y+i,m, _mm512_fmadd_ps( va,_mm512_maskz_loadu_ps(m,x+i),_mm512_maskz_loadu_ps(m,y+i) ) );
+  }
+}
+TARGET_AVX512 static void sscal2_avx512( int n,float a,const float *x,float *y ) {
+  const __m512 va = _mm512_set1_ps(a);
+  int i=0;
+  for ( ; i+16<=n; i+=16)
+    _mm512_storeu_ps( y+i, _mm512_mul_ps( va,_mm512_loadu_ps(x+i) ) );
+  if (i<n) {
+    const __mmask16 m = (1U<<(n-i))-1;
+    _mm512_mask_storeu_ps( y+i,m, _mm512_mul_ps( va,_mm512_maskz_loadu_ps(m,x+i) ) );
+  }
+}
+TARGET_AVX512 static float sdot_avx512( int n,const float *x,const float *y ) {
+  __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+  int i=0;
+  for ( ; i+32<=n; i+=32) {
+    s0 = _mm512_fmadd_ps( _mm512_loadu_ps(x+i),   _mm512_loadu_ps(y+i),   s0 );
+    s1 = _mm512_fmadd_ps( _mm512_loadu_ps(x+i+16),_mm512_loadu_ps(y+i+16),s1 );
+  }
+  for ( ; i<n; i+=16) {
+    const __mmask16 m = ( n-i>=16 ? 0xFFFF : (1U<<(n-i))-1 );
+    s0 = _mm512_fmadd_ps( _mm512_maskz_loadu_ps(m,x+i),_mm512_maskz_loadu_ps(m,y+i),s0 );
+  }
+  return _mm512_reduce_add_ps( _mm512_add_ps(s0,s1) );
+}
+// four inner products with the same x at once: loads of x are shared,
+// and the four accumulation chains hide the fma latency
+TARGET_AVX512 static void sdot4_avx512
+    ( int n,const float *a,int lda,const float *x,float *y ) {
+  __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(),
+    s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+  for (int i=0; i<n; i+=16) {
+    const __mmask16 m = ( n-i>=16 ? 0xFFFF : (1U<<(n-i))-1 );
+    const __m512 vx = _mm512_maskz_loadu_ps(m,x+i);
+    s0 = _mm512_fmadd_ps( _mm512_maskz_loadu_ps(m,a+i),      vx,s0 );
+    s1 = _mm512_fmadd_ps( _mm512_maskz_loadu_ps(m,a+i+lda),  vx,s1 );
+    s2 = _mm512_fmadd_ps( _mm512_maskz_loadu_ps(m,a+i+2*lda),vx,s2 );
+    s3 = _mm512_fmadd_ps( _mm512_maskz_loadu_ps(m,a+i+3*lda),vx,s3 );
+  }
+  y[0] = _mm512_reduce_add_ps(s0); y[1] = _mm512_reduce_add_ps(s1);
+  y[2] = _mm512_reduce_add_ps(s2); y[3] = _mm512_reduce_add_ps(s3);
+}
+
+/*
+ * AVX2: 8 floats per register
+ */
+TARGET_AVX2 static float hsum_avx2( __m256 v ) {
+  __m128 s = _mm_add_ps( _mm256_castps256_ps128(v),_mm256_extractf128_ps(v,1) );
+  s = _mm_add_ps( s,_mm_movehl_ps(s,s) );
+  s = _mm_add_ss( s,_mm_shuffle_ps(s,s,1) );
+  return _mm_cvtss_f32(s);
+}
+TARGET_AVX2 static void saxpy_avx2( int n,float a,const float *x,float *y ) {
+  const __m256 va = _mm256_set1_ps(a);
+  int i=0;
+  for ( ; i+8<=n; i+=8)
+    _mm256_storeu_ps( y+i, _mm256_fmadd_ps( va,_mm256_loadu_ps(x+i),_mm256_loadu_ps(y+i) ) );
+  saxpy_generic( n-i,a,x+i,y+i );
+}
+TARGET_AVX2 static void sscal2_avx2( int n,float a,const float *x,float *y ) {
+  const __m256 va = _mm256_set1_ps(a);
+  int i=0;
+  for ( ; i+8<=n; i+=8)
+    _mm256_storeu_ps( y+i, _mm256_mul_ps( va,_mm256_loadu_ps(x+i) ) );
+  sscal2_generic( n-i,a,x+i,y+i );
+}
+TARGET_AVX2 static float sdot_avx2( int n,const float *x,const float *y ) {
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  int i=0;
+  for ( ; i+16<=n; i+=16) {
+    s0 = _mm256_fmadd_ps( _mm256_loadu_ps(x+i),  _mm256_loadu_ps(y+i),  s0 );
+    s1 = _mm256_fmadd_ps( _mm256_loadu_ps(x+i+8),_mm256_loadu_ps(y+i+8),s1 );
+  }
+  for ( ; i+8<=n; i+=8)
+    s0 = _mm256_fmadd_ps( _mm256_loadu_ps(x+i),_mm256_loadu_ps(y+i),s0 );
+  return hsum_avx2( _mm256_add_ps(s0,s1) ) + sdot_generic( n-i,x+i,y+i );
+}
+
+/*
+ * SSE: 4 floats per register; SSE2 is part of the x86-64 baseline
+ */
+static float hsum_sse( __m128 s ) {
+  s = _mm_add_ps( s,_mm_movehl_ps(s,s) );
+  s = _mm_add_ss( s,_mm_shuffle_ps(s,s,1) );
+  return _mm_cvtss_f32(s);
+}
+static void saxpy_sse( int n,float a,const float *x,float *y ) {
+  const __m128 va = _mm_set1_ps(a);
+  int i=0;
+  for ( ; i+4<=n; i+=4)
+    _mm_storeu_ps( y+i, _mm_add_ps( _mm_mul_ps( va,_mm_loadu_ps(x+i) ),_mm_loadu_ps(y+i) ) );
+  saxpy_generic( n-i,a,x+i,y+i );
+}
+static void sscal2_sse( int n,float a,const float *x,float *y ) {
+  const __m128 va = _mm_set1_ps(a);
+  int i=0;
+  for ( ; i+4<=n; i+=4)
+    _mm_storeu_ps( y+i, _mm_mul_ps( va,_mm_loadu_ps(x+i) ) );
+  sscal2_generic( n-i,a,x+i,y+i );
+}
+static float sdot_sse( int n,const float *x,const float *y ) {
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  int i=0;
+  for ( ; i+8<=n; i+=8) {
+    s0 = _mm_add_ps( s0,_mm_mul_ps( _mm_loadu_ps(x+i),  _mm_loadu_ps(y+i)   ) );
+    s1 = _mm_add_ps( s1,_mm_mul_ps( _mm_loadu_ps(x+i+4),_mm_loadu_ps(y+i+4) ) );
+  }
+  return hsum_sse( _mm_add_ps(s0,s1) ) + sdot_generic( n-i,x+i,y+i );
+}
+
+#endif // SIMD_X86
+
+/*
+ * Dispatchers
+ */
+void saxpy_simd( int n,float a,const float *x,float *y ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : saxpy_avx512(n,a,x,y); break;
+  case simd_isa::avx2   : saxpy_avx2  (n,a,x,y); break;
+  case simd_isa::sse    : saxpy_sse   (n,a,x,y); break;
+#endif
+  default               : saxpy_generic(n,a,x,y);
+  }
+}
+
+void sscal2_simd( int n,float a,const float *x,float *y ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : sscal2_avx512(n,a,x,y); break;
+  case simd_isa::avx2   : sscal2_avx2  (n,a,x,y); break;
+  case simd_isa::sse    : sscal2_sse   (n,a,x,y); break;
+#endif
+  default               : sscal2_generic(n,a,x,y);
+  }
+}
+
+float sdot_simd( int n,const float *x,const float *y ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : return sdot_avx512(n,x,y);
+  case simd_isa::avx2   : return sdot_avx2  (n,x,y);
+  case simd_isa::sse    : return sdot_sse   (n,x,y);
+#endif
+  default               : return sdot_generic(n,x,y);
+  }
+}
+
+/*
+ * Matrix-vector product by rows is a sequence of inner products;
+ * the transpose product is a sequence of axpys with the rows,
+ * so in both cases the matrix is traversed with stride 1.
+ */
+void sgemv_simd( bool trans,int m,int n,const float *a,int lda,const float *x,float *y ) {
+  if (not trans) {
+    int i=0;
+#ifdef SIMD_X86
+    if (simd_level()==simd_isa::avx512)
+      for ( ; i+4<=m; i+=4)
+	sdot4_avx512( n,a+i*lda,lda,x,y+i );
+#endif
+    for ( ; i<m; i++)
+      y[i] = sdot_simd( n,a+i*lda,x );
+  } else {
+    std::memset( y,0,n*sizeof(float) );
+    for (int i=0; i<m; i++)
+      saxpy_simd( n,x[i],a+i*lda,y );
+  }
+}
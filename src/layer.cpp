@@ -13,6 +13,7 @@
 
 #include "layer.h"
 #include "trace.h"
+#include "parallel.h"
 
 #include <iostream>
 using std::cout;
@@ -20,10 +21,10 @@ using std::endl;
 
 Layer::Layer() {};
 Layer::Layer(int insize,int outsize)
-  : weights( Matrix(outsize,insize,1) ),
-    dw     ( Matrix(outsize,insize, 0) ),
+  : weights( Matrix(outsize,insize,1,true) ),
+    dw     ( Matrix(outsize,insize, 0,true) ),
 	//dW( Matrix(outsize,insize, 0) ),
-    dw_velocity( Matrix(outsize,insize, 0) ),
+    dw_velocity( Matrix(outsize,insize, 0,true) ),
     biases( Vector(outsize, 1 ) ),
     // biased_product( Vector(outsize, 0) ),
     activated( Vector(outsize, 0) ),
@@ -32,10 +33,10 @@ Layer::Layer(int insize,int outsize)
     // biased_productm( VectorBatch(outsize,insize,0) ),
     //    activated_batch( VectorBatch(outsize,1, 0) ),
     //    d_activated_batch ( VectorBatch(outsize,insize, 0) ),
-    db( Vector(insize, 0) ),
+    db( Vector(outsize, 0) ),
     // delta_mean( Vector(insize, 0) ),
     dl( VectorBatch(insize, 1) ),
-    db_velocity( Vector(insize, 0) ) {};
+    db_velocity( Vector(outsize, 0) ) {};
 
 /*
  * Resize temporaries to reflect current batch size
@@ -43,29 +44,117 @@ Layer::Layer(int insize,int outsize)
 void Layer::allocate_batch_specific_temporaries(int batchsize) {
   const int insize = weights.colsize(), outsize = weights.rowsize();
 
+  if (_layout==feature_major) {
+    // an elementwise activation: the fused kernels need nothing else
+    activated_by_feature.allocate( batchsize,outsize );
+    if (frozen()) return;
+    delta_by_feature.allocate( batchsize,outsize );
+    if (keeps_preactivation())
+      preactivated_by_feature.allocate( batchsize,outsize );
+    return;
+  }
   activated_batch.allocate( batchsize,outsize );
-  d_activated_batch.allocate( batchsize,outsize );
-  dl.allocate( batchsize, outsize );
+  if (softmax_output())
+    log_activated.allocate( batchsize,outsize );
+  if (frozen()) return;
   delta.allocate( batchsize,outsize );
+  if (keeps_preactivation())
+    preactivated.allocate( batchsize,outsize );
+  // only the unfused backward path needs these,
+  // the derivative as a batch only for user functions
+  if (not fused_backward())
+    dl.allocate( batchsize, outsize );
+  if (custom_activation)
+    d_activated_batch.allocate( batchsize,outsize );
+};
+
+/*
+ * The same temporaries as slices of a workspace owned by the net,
+ * for batches up to maxbatch; see Net::reserve_workspace.
+ */
+int Layer::workspace_size(int maxbatch) const {
+  const int n = maxbatch*output_size();
+  const int nbatches = 2 + ( fused_backward() ? 0 : 1 )
+    + ( custom_activation ? 1 : 0 ) + ( softmax_output() ? 1 : 0 )
+    + ( keeps_preactivation() ? 1 : 0 );
+  return nbatches * Workspace::slice_size(n);
+};
+
+void Layer::use_workspace(Workspace &w,int maxbatch) {
+  const int n = maxbatch*output_size();
+  if (_layout==feature_major) {
+    activated_by_feature.use_workspace( w,n );
+    delta_by_feature.use_workspace( w,n );
+    if (keeps_preactivation())
+      preactivated_by_feature.use_workspace( w,n );
+    return;
+  }
+  activated_batch.use_workspace( w,n );
+  delta.use_workspace( w,n );
+  if (not fused_backward())
+    dl.use_workspace( w,n );
+  if (custom_activation)
+    d_activated_batch.use_workspace( w,n );
+  if (softmax_output())
+    log_activated.use_workspace( w,n );
+  if (keeps_preactivation())
+    preactivated.use_workspace( w,n );
+};
+
+/*
+ * For inference we only need the weights and biases,
+ * and the output of the forward pass, with its log for a softmax,
+ * so that the loss is the same as in training;
+ * the net points activated_batch at its ping-pong buffers.
+ * The single sample `activated' vector is kept.
+ */
+void Layer::freeze() {
+  dw = Matrix(); dw_velocity = Matrix();
+  db = Vector(); db_velocity = Vector();
+  d_activated = Vector();
+  for ( auto b : { &activated_batch,&delta,&wdelta,&dl,&Dscale,&d_activated_batch,&log_activated,&preactivated } )
+    b->release();
+  for ( auto b : { &activated_by_feature,&delta_by_feature,&preactivated_by_feature } )
+    b->release();
+  _frozen = true;
 };
 
 void Layer::set_activation(acFunc f) {
   activation = f;
-  apply_activation_batch  = apply_activation<VectorBatch>.at(f);
-  activate_gradient_batch = activate_gradient<VectorBatch>.at(f);
+  custom_activation = false;
+  apply_activation_batch  = nullptr;
+  activate_gradient_batch = nullptr;
 };
 
 void Layer::set_activation
 ( std::function< void(const VectorBatch&,VectorBatch&) > apply,
   std::function< void(const VectorBatch&,VectorBatch&) > activate ) {
   activation = acFunc::RELU;
+  custom_activation = true;
+  _layout = sample_major;
   apply_activation_batch  = apply;
   activate_gradient_batch = activate;
 };
 
+/*
+ * Feature major, every feature of the batch is a contiguous row,
+ * which suits the elementwise activations, whatever the layer size.
+ * The softmax, the user functions, and the loss go by sample,
+ * so those layers, and the output layer, are sample major.
+ */
+void Layer::set_layout( batch_layout l ) {
+  if (l==feature_major and not fused_backward())
+    throw(std::string("only an elementwise activation can be feature major"));
+  _layout = l;
+};
+
 void Layer::set_uniform_weights(float v) {
-  for ( auto& e : weights.values() )
-    e = v;
+  // only the logical elements: the row padding stays zero
+  const int ld = weights.leading_dimension();
+  float *w = weights.data();
+  for ( int i=0; i<weights.rowsize(); i++ )
+    for ( int j=0; j<weights.colsize(); j++ )
+      w[ i*ld+j ] = v;
 };
 
 void Layer::set_uniform_biases(float v) {
@@ -74,35 +163,105 @@ void Layer::set_uniform_biases(float v) {
 };
 
 //codesnippet layerforward
-void Layer::forward(const VectorBatch &prevVals) {
+template< typename InLayout >
+void Layer::forward(const BasicVectorBatch<InLayout> &prevVals,int approximation) {
 #ifdef DEBUG
   cout << "Forward layer " << layer_number
        << ": " << input_size() << "->" << output_size() << endl;
 #endif
 
     assert( prevVals.notnan() ); assert( prevVals.notinf() );
-    prevVals.v2mp( weights, activated_batch );
-    assert( activated_batch.notnan() ); assert( activated_batch.notinf() );
-
-    activated_batch.addh(biases); // Add the bias
-    assert( activated_batch.notnan() ); assert( activated_batch.notinf() );
-
-    apply_activation_batch(activated_batch, activated_batch);
+    if (_layout==feature_major) {
+      // an elementwise activation, see set_layout
+      if (keeps_preactivation() and not frozen()) {
+	prevVals.v2mp_bias_act( weights, biases, NONE, preactivated_by_feature );
+	apply_activation_io( activation, preactivated_by_feature, activated_by_feature, approximation );
+      } else
+	prevVals.v2mp_bias_act( weights, biases, activation, activated_by_feature, approximation );
+      assert( activated_by_feature.notnan() ); assert( activated_by_feature.notinf() );
+      return;
+    }
+    if (custom_activation) {
+      prevVals.v2mp( weights, activated_batch );
+      activated_batch.addh(biases); // Add the bias
+      apply_activation_batch(activated_batch, activated_batch);
+    } else if (keeps_preactivation() and not frozen()) {
+      // the backward sweep needs the input of the activation
+      prevVals.v2mp_bias_act( weights, biases, NONE, preactivated );
+      apply_activation_io( activation, preactivated, activated_batch, approximation );
+    } else {
+      // product, bias, and elementwise activation in one sweep
+      prevVals.v2mp_bias_act( weights, biases, activation, activated_batch, approximation );
+      // we also keep the log, for a stable cross entropy
+      if (activation==SMAX)
+	softmax_io(activated_batch, activated_batch, log_activated, approximation);
+    }
     assert( activated_batch.notnan() ); assert( activated_batch.notinf() );
 }
 //codesnippet end
 
+/*
+ * Single sample forward, for inference.
+ * This writes the `activated' vector that the constructor allocated,
+ * so built-in activations do no allocation at all.
+ */
+void Layer::forward(const Vector &prevVals,int approximation) {
+    if (custom_activation) {
+      // the user functions take a batch: go through a batch of one
+      weights.mvp( prevVals, activated );
+      activated.add(biases);
+      VectorBatch one( 1,output_size() );
+      std::copy( activated.values().begin(),activated.values().end(),
+		 one.vals_vector().begin() );
+      apply_activation_batch(one, one);
+      std::copy( one.vals_vector().begin(),one.vals_vector().end(),
+		 activated.values().begin() );
+    } else {
+      weights.mvp_bias_act( prevVals, biases, activation, activated, approximation );
+      if (activation==SMAX)
+	softmax_inplace(activated,approximation);
+    }
+}
+
+template< typename DeltaLayout,typename PrevLayout >
 void Layer::backward
-    (const VectorBatch &prev_delta, const Matrix &W, const VectorBatch &prev_output) {
+    (const BasicVectorBatch<DeltaLayout> &prev_delta, const Matrix &W,
+     const BasicVectorBatch<PrevLayout> &prev_output) {
 
   // compute delta ell
-  activate_gradient_batch(activated_batch, d_activated_batch); 
-  prev_delta.v2mtp( W, dl );
-   // delta  = Dl . sigma
-  delta.hadamard( d_activated_batch,dl ); // Derivative of the current layer
-  if (trace_scalars())
-    cout << "L-" << layer_number << " delta: "
-	 << d_activated_batch.normf() << "x" << dl.normf() << " => " << delta.normf() << "\n";
+  if (_layout==feature_major) {
+    // always fused, see set_layout
+    prev_delta.v2mtp_act_grad
+      ( W, ( keeps_preactivation() ? preactivated_by_feature : activated_by_feature ),
+	activation, delta_by_feature );
+    if (trace_scalars())
+      cout << "L-" << layer_number << " delta: "
+	   << "fused, feature major => " << delta_by_feature.normf() << "\n";
+    update_dw(delta_by_feature, prev_output);
+    return;
+  }
+  if (fused_backward()) {
+    // delta = W^t prev_delta . sigma', with sigma' recomputed from the activated values
+    prev_delta.v2mtp_act_grad( W, gradient_argument(), activation, delta );
+    if (trace_scalars())
+      cout << "L-" << layer_number << " delta: "
+	   << "fused => " << delta.normf() << "\n";
+  } else if (softmax_output()) {
+    // delta = J dl, sample by sample, without forming the Jacobian J
+    prev_delta.v2mtp( W, dl );
+    smaxGrad_io( activated_batch, dl, delta );
+    if (trace_scalars())
+      cout << "L-" << layer_number << " delta: "
+	   << "softmax " << dl.normf() << " => " << delta.normf() << "\n";
+  } else {
+    activate_gradient_batch(activated_batch, d_activated_batch); 
+    prev_delta.v2mtp( W, dl );
+    // delta  = Dl . sigma
+    delta.hadamard( d_activated_batch,dl ); // Derivative of the current layer
+    if (trace_scalars())
+      cout << "L-" << layer_number << " delta: "
+	   << d_activated_batch.normf() << "x" << dl.normf() << " => " << delta.normf() << "\n";
+  }
 
   // prev_output.outer2( delta, dw );
   // if (trace_scalars())
@@ -115,29 +274,95 @@ void Layer::backward
   // biases.add( db );
 }
 
-void Layer::update_dw( const VectorBatch &delta, const VectorBatch& prev_output) {
+template< typename DeltaLayout,typename PrevLayout >
+void Layer::update_dw
+    ( const BasicVectorBatch<DeltaLayout> &delta, const BasicVectorBatch<PrevLayout>& prev_output) {
    prev_output.outer2( delta, dw );
    if (trace_scalars())
      cout << "L-" << layer_number << " dw: "
 	  << delta.normf() << "x" << prev_output.normf() << " => " << dw.normf() << "\n";
 
-  // Delta W = delta here X activated prevous
-  weights.axpy( 1.,dw );
-  db = delta.meanh();
-  biases.add( db );
+  // Delta W = delta here X activated prevous;
+  // the weights and biases are only changed by the optimizer, see Net::SGD,
+  // so the layers below still backpropagate through the current weights.
+  // Like dw, db is summed over the batch; the optimizers divide by the batch size
+  delta.sumh( db );
 }
 
-void Layer::set_topdelta( const VectorBatch& gTruth ) {
+/*
+ * The delta of the output layer, and the loss of the batch in the same sweep;
+ * this returns the loss per sample, as Net::calculateLoss.
+ * The delta is the derivative of the loss summed over the batch, times the batch size;
+ * the optimizers divide that out again.
+ */
+float Layer::set_topdelta( const VectorBatch& gTruth,lossfn loss ) {
 
+  const int n = delta.size(), bs = gTruth.batch_size();
+  assert( gTruth.size()==n );
+  float sum{0.f};
     // top delta ell is different
+  if (softmax_output() and loss==cce) {
+    // the softmax Jacobian times the derivative of the cross entropy
+    // collapses to activated - gTruth for each sample: no Jacobian needed.
+    // The loss is - gTruth log activated, from the log-sum-exp of the forward sweep
+    const float *avals = activated_batch.data(), *gvals = gTruth.data(),
+      *logvals = log_activated.data();
+    float *dvals = delta.data();
+#pragma omp parallel for reduction(+:sum) if(n>=parallel_threshold())
+    for (int i=0; i<n; i++) {
+      dvals[i] = ( avals[i]-gvals[i] )*bs;
+      sum -= gvals[i]*logvals[i];
+    }
+    if (trace_scalars())
+      cout << "L-" << layer_number << " delta: "
+	   << "softmax cross entropy => " << delta.normf() << "\n";
+  } else if (fused_backward()) {
+    // delta = loss'( activated ) . sigma', in one sweep
+    const float *avals = activated_batch.data(), *gvals = gTruth.data(),
+      *zvals = gradient_argument().data();
+    float *dvals = delta.data();
+    with_loss
+      ( loss,[&] ( auto lossf ) {
+	with_elementwise_activation
+	  ( activation,[&] ( auto act ) {
+	    using Act = decltype(act);
+	    sum = loss_and_error<decltype(lossf)>
+	      ( n,avals,gvals,bs,[zvals] ( int i ) { return Act::grad( zvals[i] ); },dvals );
+	  } );
+      } );
+    if (trace_scalars())
+      cout << "L-" << layer_number << " delta: "
+	   << "fused => " << delta.normf() << "\n";
+  } else if (softmax_output()) {
+    // any other loss: the Jacobian product with the loss derivative
+    sum = loss_error_io( loss,activated_batch,gTruth,dl );
+    smaxGrad_io( activated_batch, dl, delta );
+    if (trace_scalars())
+      cout << "L-" << layer_number << " delta: "
+	   << "softmax " << dl.normf() << " => " << delta.normf() << "\n";
+  } else {
    activate_gradient_batch(activated_batch, d_activated_batch); 
-   dl = activated_batch - gTruth;
-   dl.scaleby( 1.f / gTruth.batch_size() );
    // delta  = Dl . sigma
-   delta.hadamard( d_activated_batch,dl );
+   sum = loss_error_io( loss,activated_batch,gTruth,d_activated_batch,delta );
    if (trace_scalars())
      cout << "L-" << layer_number << " delta: "
-	  << d_activated_batch.normf() << "x" << dl.normf() << " => " << delta.normf() << "\n";
+	  << d_activated_batch.normf() << " => " << delta.normf() << "\n";
+  }
 
    //  update_dw(delta, prev_output);
+  return sum / bs;
 };
+
+/*
+ * The layers around this one can have either layout
+ */
+template void Layer::forward( const VectorBatch&,int );
+template void Layer::forward( const FeatureMajorBatch&,int );
+#define LAYER_BACKWARD( D,P )						\
+  template void Layer::backward( const D&,const Matrix&,const P& );	\
+  template void Layer::update_dw( const D&,const P& );
+LAYER_BACKWARD( VectorBatch,VectorBatch )
+LAYER_BACKWARD( VectorBatch,FeatureMajorBatch )
+LAYER_BACKWARD( FeatureMajorBatch,VectorBatch )
+LAYER_BACKWARD( FeatureMajorBatch,FeatureMajorBatch )
+#undef LAYER_BACKWARD
@@ -30,11 +30,16 @@ public:
 
 private: // but note that Net is a `friend' class!
     Vector biases; // Biases which come before the layer
-    acFunc activation; // Activation functions of the layer
+    acFunc activation{RELU}; // Activation functions of the layer
+    bool custom_activation{false}; // user supplied functions: no fused kernels
     //Vector biased_product; // Values in the layer n after multiplying vals from n-1 and weights
     Matrix weights; // Weights which come before the layer
     Vector activated;
     VectorBatch activated_batch,delta,wdelta,dl,Dscale;
+    VectorBatch log_activated; // softmax output layer: log of activated_batch
+    VectorBatch preactivated; // input of the activation, if its derivative needs that
+    // a feature-major layer keeps its output, delta and preactivation here, see set_layout
+    FeatureMajorBatch activated_by_feature,delta_by_feature,preactivated_by_feature;
     Vector d_activated; // for backpropagation
     //VectorBatch biased_productm;
     VectorBatch d_activated_batch;
@@ -57,19 +62,62 @@ public:
     int output_size() const { return weights.rowsize(); };
   //    void set_initial_deltas( const Matrix&, const Vector& );
     void set_recursive_deltas( Vector &, const Layer&,const Layer& );
-    void set_topdelta( const VectorBatch& );
+    float set_topdelta( const VectorBatch&,lossfn );
     void allocate_batch_specific_temporaries(int batchsize);
-    void forward( const VectorBatch &prevVals);
-    void backward(const VectorBatch &delta, const Matrix &W, const VectorBatch &prev);
+    int workspace_size(int maxbatch) const;
+    void use_workspace(Workspace &w,int maxbatch);
+    //! inference only: drop everything that only training needs
+    void freeze();
+    bool frozen() const { return _frozen; };
+    //! the layout of the output and delta batches;
+    //! feature major only for an elementwise built-in activation
+    void set_layout( batch_layout l );
+    batch_layout layout() const { return _layout; };
+    //! f( output batch ), f( delta batch ), in the layout of the layer
+    template< typename F >
+    void with_output( F &&f ) const {
+      if (_layout==feature_major) f( activated_by_feature ); else f( activated_batch ); };
+    template< typename F >
+    void with_delta( F &&f ) const {
+      if (_layout==feature_major) f( delta_by_feature ); else f( delta ); };
+private:
+    bool _frozen{false};
+    batch_layout _layout{sample_major};
+public:
+    // approximation: the degree of the exponential, see Net::set_approximation;
+    // the batches of the layers around this one can have either layout
+    template< typename InLayout >
+    void forward( const BasicVectorBatch<InLayout> &prevVals,int approximation );
+    void forward( const Vector &prevVals,int approximation );
+    template< typename DeltaLayout,typename PrevLayout >
+    void backward(const BasicVectorBatch<DeltaLayout> &delta, const Matrix &W,
+		  const BasicVectorBatch<PrevLayout> &prev);
+    //! elementwise built-in activations compute delta in one fused sweep
+    bool fused_backward() const { return not custom_activation and activation!=SMAX; };
+    //! built-in softmax: keeps the log of its output, see log_activated
+    bool softmax_output() const { return not custom_activation and activation==SMAX; };
+    //! GELU, SiLU: keep the input of the activation, see preactivated
+    bool keeps_preactivation() const { return not custom_activation and grad_of_input(activation); };
+    //! the values the fused derivative is computed from
+    const VectorBatch &gradient_argument() const {
+      return ( keeps_preactivation() ? preactivated : activated_batch ); };
     void backward_update( const VectorBatch&, const VectorBatch& ,bool=false );
-    void update_dw(const VectorBatch &delta, const VectorBatch& prevValues);
+    template< typename DeltaLayout,typename PrevLayout >
+    void update_dw(const BasicVectorBatch<DeltaLayout> &delta,
+		   const BasicVectorBatch<PrevLayout> &prevValues);
+    //! the parameters, and the gradients of the loss summed over the batch
+    //! from the last backpropagation; for checking against differences
+    Matrix &weight_values() { return weights; };
+    Vector &bias_values() { return biases; };
+    const Matrix &weight_gradient() const { return dw; };
+    const Vector &bias_gradient() const { return db; };
 
 		 
 private:
-  std::function< void(const VectorBatch&,VectorBatch&) > apply_activation_batch{
-    [] ( const VectorBatch &v, VectorBatch &a ) { relu_io(v,a); } };
-  std::function< void(const VectorBatch&,VectorBatch&) > activate_gradient_batch{
-    [] ( const VectorBatch &v, VectorBatch &a ) { reluGrad_io(v,a); } };
+  // only for user supplied activations, called through std::function;
+  // the built-in ones are compiled into the kernels, see `activation'
+  std::function< void(const VectorBatch&,VectorBatch&) > apply_activation_batch;
+  std::function< void(const VectorBatch&,VectorBatch&) > activate_gradient_batch;
 public:
   void set_activation(acFunc f);
   void set_activation
@@ -17,31 +17,52 @@
 #include <vector>
 #include "vector.h"
 //#include "vector2.h"
+#include "expr.h"
+#include "aligned.h"
 #include <initializer_list>
 
+enum acFunc : int; // see funcs.h
+
+/*
+ * Stored by rows, with row length ld >= c:
+ * element (i,j) is mat[ i*ld+j ].
+ * A padded matrix has its rows padded with zeros to whole cache lines,
+ * so that every row starts aligned, see aligned.h;
+ * elementwise operations go over the padding too,
+ * so only combine matrices with the same padding.
+ */
 class Matrix{
 private: // should really become private
-	std::vector<float> mat;
+	aligned_vector mat;
     int r;
     int c;
+    int ld;
 public:
     Matrix();
-    Matrix(int nRows, int nCols, int rand);
+    Matrix(int nRows, int nCols, int rand, bool padded=false);
+    // evaluate an elementwise expression, see expr.h
+    template< typename E >
+    Matrix( const expr<E> &e ) { *this = e; };
     // for mpl
-    std::vector<float> &values() { return mat; };
-    const std::vector<float> &values() const { return mat; };
+    aligned_vector &values() { return mat; };
+    const aligned_vector &values() const { return mat; };
     float* data() ;
     const float* data() const;
     int nelements() const {
-      return mat.size();
+      return r*c;
     };
     int rowsize() const { return r; };
     int colsize() const { return c; };
+    int leading_dimension() const { return ld; };
     Matrix transpose() const;	
     void show() const;
     //void flatten();
     void mvpt( const Vector &x, Vector &y ) const;
     void mvp( const Vector &x, Vector &y ) const;
+    // y = act( self x + b ), fused; for SMAX only the bias is applied;
+    // the exponential of degree approximation, see vmath.h
+    void mvp_bias_act( const Vector &x, const Vector &b, acFunc f, Vector &y,
+		       int approximation=0 ) const;
     void addvh( const Vector &y); // Add a vector to each column
     
 	void mmp( const Matrix &x, Matrix &y) const;
@@ -58,18 +79,29 @@ public:
     //void outer2( const VectorBatch &x, const VectorBatch &y );
 	
 
-	Matrix operator-(); // Unary negate operator
-    Matrix& operator=(const Matrix& m2); // Copy constructor
-    Matrix operator+(const Matrix &m2) const; // Element-wise addition
-    Matrix operator*(const Matrix &m2); // Hadamard Product Element-wise multiplication
-    Matrix operator/(const Matrix &m2); // Element-wise division
-    Matrix operator-(const Matrix &m2); // Element-wise subtraction
-    friend Matrix operator*(const float &c, const Matrix &m); // for constant-matrix multiplication
-    friend Matrix operator/(const Matrix &m, const float &c); // for matrix-constant division
+    // plain copies and moves of the values
+    Matrix( const Matrix& ) = default;
+    Matrix( Matrix&& ) = default;
+    Matrix& operator=( const Matrix& ) = default;
+    Matrix& operator=( Matrix&& ) = default;
+    // Element-wise +,-,*,/, and with a scalar, are expressions: see expr.h
+    template< typename E >
+    Matrix& operator=( const expr<E> &e ) {
+      const Matrix &s = e.self().shape();
+      r = s.r; c = s.c; ld = s.ld;
+      mat.resize( r*ld );
+      expr_evaluate( e,mat.data() );
+      return *this;
+    };
   void axpy( float a,const Matrix &x );
 
 };
 
+template<>
+struct expr_container<Matrix> : std::true_type {
+  static int size( const Matrix &m ) { return m.values().size(); };
+};
+
 
 
 #endif
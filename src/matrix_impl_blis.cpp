@@ -12,6 +12,7 @@
  ****************************************************************/
 
 #include "matrix.h"
+#include "blas.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -23,30 +24,30 @@ using std::vector;
 #include "blis/blis.h"
 #endif
 
-Matrix::Matrix(int nRows, int nCols, int random = 0)
-        : r(nRows), c(nCols) {
+Matrix::Matrix(int nRows, int nCols, int random = 0, bool padded)
+        : r(nRows), c(nCols), ld( padded ? padded_size(nCols) : nCols ) {
 
-	mat = vector<float>(nRows * nCols);
+	mat = aligned_vector(nRows * ld);
 	float scal_fac = 0.05; // randomize between (-1;1)
 	if (random==0){
 		float zero = 0.0;
 		bli_ssetm( BLIS_NO_CONJUGATE, 0, BLIS_NONUNIT_DIAG, BLIS_DENSE,
-				r, c, &zero, &mat[0], c, 1);
+				r, c, &zero, &mat[0], ld, 1);
 	} else if (random==1){
-		bli_srandm(0, BLIS_DENSE, r, c, &mat[0], c, 1);
+		bli_srandm(0, BLIS_DENSE, r, c, &mat[0], ld, 1);
 		bli_sscalm( BLIS_NO_CONJUGATE, 0, BLIS_NONUNIT_DIAG, BLIS_DENSE,
-				r, c, &scal_fac, &mat[0], c, 1);
+				r, c, &scal_fac, &mat[0], ld, 1);
 	}
 }
 		
 Matrix Matrix::transpose() const {
-    Matrix result(c, r, 0); // Initialize a new matrix with inverted dimension values
+    Matrix result(c, r, 0, ld!=c); // Initialize a new matrix with inverted dimension values
 
 	// m = r, n = c
 	// rs = 1, cs = m, rsf = 1, csf = n
     //printf("BLIS copy %dx%d\n",c,r);
     bli_scopym( 0, BLIS_NONUNIT_DIAG, BLIS_DENSE, BLIS_TRANSPOSE,
-		c, r, const_cast<float*>(&mat[0]), c, 1, &result.mat[0], r, 1);  
+		c, r, const_cast<float*>(&mat[0]), 1, ld, &result.mat[0], result.ld, 1);  
     return result;
 }
 
@@ -54,75 +55,60 @@ void Matrix::show() const {
 
 	char e[5] = "";
 	char format[8] = "%4.4f";
-	bli_sprintm( e, r, c, const_cast<float*>(&mat[0]), c, 1, format, e );
+	bli_sprintm( e, r, c, const_cast<float*>(&mat[0]), ld, 1, format, e );
 }
 
 
+/*
+ * The matrix is stored by rows,
+ * which to the column-major blas backend is its transpose
+ */
 void Matrix::mvp(const Vector &x, Vector &y) const {
 	assert( c==x.size() ); 
 	assert( r==y.size() );
+	blas_sgemv( true, c,r, 1.f, mat.data(),ld, x.data(),1, 0.f, y.data(),1 );
+}
 
-	float alpha = 1.0;
-	float beta = 0.0;
-	//printf("BLIS gemv %dx%d\n",c,r);
-	bli_sgemv( BLIS_NO_TRANSPOSE, BLIS_NO_CONJUGATE,
-		   r, c, &alpha, const_cast<float*>(&mat[0]),
-		   c, 1, const_cast<float*>( x.data() ) /* &t.vals[0] */,
-		   // c, 1, &t.vals[0] ,
-		   1, &beta, &y.vals[0], 1 );  
-
+void Matrix::mvp_bias_act
+    (const Vector &x, const Vector &b, acFunc f, Vector &y, int approximation) const {
+	assert( c==x.size() );
+	assert( r==y.size() );
+	assert( r==b.size() );
+	blas_sgemv_bias_act( true, c,r, mat.data(),ld, x.data(), y.data(), b.data(), f,approximation );
 }
 
 void Matrix::mvpt(const Vector &x, Vector &y) const {
 	assert( r==x.size() );
 	assert( c==y.size() );
-
-	float alpha = 1.0;
-	float beta = 0.0;
-	//printf("BLIS gemv %dx%d\n",c,r);
-	bli_sgemv( BLIS_TRANSPOSE, BLIS_NO_CONJUGATE,
-		   r, c, &alpha, const_cast<float*>(&mat[0]), // test if r and c need to be flipped
-		   //c, 1, &t.vals[0],
-		   c, 1, const_cast<float*>( x.data() ),
-		   1, &beta, &y.vals[0], 1 );  
+	blas_sgemv( false, c,r, 1.f, mat.data(),ld, x.data(),1, 0.f, y.data(),1 );
 }
 
 
 void Matrix::outerProduct(const Vector &x, const Vector &y) {
 	assert( x.size() == r );
 	assert( y.size() == c );
-	float val = 1.0;
-
-	//printf("BLIS gemm (outer) %dx%d\n",r,c);
-	bli_sgemm( BLIS_NO_TRANSPOSE, BLIS_TRANSPOSE,
-			r, c, 1, &val, 
-			const_cast<float*>(x.data()), 1, 1, 
-			const_cast<float*>(y.data()), c, 1, &val, &mat[0], c, 1);
-
+	// by rows m = x y^t, so by columns it is y x^t
+	blas_sgemm( false,false, c,r,1,
+		    1.f, y.data(),c, x.data(),1,
+		    1.f, mat.data(),ld );
 }
 
-
-void Matrix::mmp(const Matrix &x, Matrix &y) const { // In place matrix matrix multiplication
+void Matrix::mmp(const Matrix &x, Matrix &y) const {
 	assert( c==x.r );
 	assert( r==y.r );
 	assert( x.c==y.c );
-
-	float alpha = 1.0;
-	float beta = 0.0;
-	// m = r, n = x.c, k = c
-	//printf("BLIS gemm %dx%dx%d\n",r,x.c,c);
-	bli_sgemm( BLIS_NO_TRANSPOSE, BLIS_NO_TRANSPOSE, 
-		   r, x.c, c, &alpha, const_cast<float*>(&mat[0]),
-		   //c, 1, &t.mat[0],
-		   c, 1, const_cast<float*>( x.data() ),
-		   x.c, 1, &beta, &y.mat[0], x.c, 1);
+	// by rows y = self x, so by columns it is x self
+	blas_sgemm( false,false, x.c,r,c,
+		    1.f, x.mat.data(),x.ld, mat.data(),ld,
+		    0.f, y.mat.data(),y.ld );
 }
 
 void Matrix::axpy( float a,const Matrix &x ) {
   assert( r==x.r );
   assert( c==x.c );
-  const int n = nelements();
-  assert( n==x.nelements() );
+  assert( ld==x.ld );
+  // padding included: it is zero in both
+  const int n = values().size();
 
   bli_saxpyv( BLIS_NO_CONJUGATE,
 	      n, &a, const_cast<float*>( x.data() ),1,
@@ -131,8 +117,7 @@ void Matrix::axpy( float a,const Matrix &x ) {
 
 float Matrix::normf() const {
   float norm;
-  auto r = rowsize(), c = colsize();
   const auto mval = values().data();
-  bli_snormfv( r*c, const_cast<float*>(mval), 1, &norm );
+  bli_snormfv( values().size(), const_cast<float*>(mval), 1, &norm );
   return norm;
 };
@@ -0,0 +1,137 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of 
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code 
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "matrix.h"
+#include "blas.h"
+#include "simd.h"
+#include "parallel.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+using std::vector;
+
+Matrix::Matrix(int nRows, int nCols, int random = 0, bool padded)
+  : r(nRows), c(nCols), ld( padded ? padded_size(nCols) : nCols ) {
+
+  mat = aligned_vector(nRows * ld);
+  int i, j;
+  if (random==0) {
+    std::fill(mat.begin(), mat.end(), 0);
+  } else if (random==1) {
+    //std::fill(mat.begin(), mat.end(), .5);
+    for (i=0; i<nRows;i++){
+      for (j=0; j<nCols; j++) {
+	//mat[i*ld+j] = -0.1 + static_cast <float> (rand()) /( static_cast <float>(RAND_MAX/(0.1-(-0.1))));
+	mat[i*ld+j] = -0.1 + static_cast <float> (rand()) /( static_cast <float>(RAND_MAX) );
+      }
+    }
+  }
+
+}
+		
+Matrix Matrix::transpose() const {
+    Matrix result(c, r, 0, ld!=c); // Initialize a new matrix with inverted dimension values
+    int i1, i2; // Old and new index
+    for (int i = 0; i < r; i++) {
+        for (int j = 0; j < c; j++) {
+            i1 = i * ld + j; // Old indexing
+            i2 = j * result.ld + i; // New indexing
+
+            result.mat[i2] = mat[i1]; // Move transposed values to new array
+        }
+    }
+
+    return result;
+}
+
+void Matrix::show() const {
+
+    int i, j;
+    for (i = 0; i < r; i++) {
+        for (j = 0; j < c; j++) {
+            std::cout << mat[i * ld + j] << ' ';
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+
+}
+
+
+/*
+ * The matrix is stored by rows,
+ * which to the column-major blas backend is its transpose
+ */
+void Matrix::mvp(const Vector &x, Vector &y) const {
+	assert( c==x.size() ); 
+	assert( r==y.size() );
+	blas_sgemv( true, c,r, 1.f, mat.data(),ld, x.data(),1, 0.f, y.data(),1 );
+}
+
+void Matrix::mvp_bias_act
+    (const Vector &x, const Vector &b, acFunc f, Vector &y, int approximation) const {
+	assert( c==x.size() );
+	assert( r==y.size() );
+	assert( r==b.size() );
+	blas_sgemv_bias_act( true, c,r, mat.data(),ld, x.data(), y.data(), b.data(), f,approximation );
+}
+
+void Matrix::mvpt(const Vector &x, Vector &y) const {
+	assert( r==x.size() );
+	assert( c==y.size() );
+	blas_sgemv( false, c,r, 1.f, mat.data(),ld, x.data(),1, 0.f, y.data(),1 );
+}
+
+
+void Matrix::outerProduct(const Vector &x, const Vector &y) {
+	assert( x.size() == r );
+	assert( y.size() == c );
+	// by rows m = x y^t, so by columns it is y x^t
+	blas_sgemm( false,false, c,r,1,
+		    1.f, y.data(),c, x.data(),1,
+		    0.f, mat.data(),ld );
+}
+
+void Matrix::mmp(const Matrix &x, Matrix &y) const {
+	assert( c==x.r );
+	assert( r==y.r );
+	assert( x.c==y.c );
+	// by rows y = self x, so by columns it is x self
+	blas_sgemm( false,false, x.c,r,c,
+		    1.f, x.mat.data(),x.ld, mat.data(),ld,
+		    0.f, y.mat.data(),y.ld );
+}
+
+void Matrix::axpy( float a,const Matrix &x ) {
+  assert( r==x.r );
+  assert( c==x.c );
+  assert( ld==x.ld );
+  // padding included: it is zero in both
+  const int n = values().size();
+  if (n<parallel_threshold()) {
+    saxpy_simd( n, a, x.data(), data() );
+  } else {
+    // each thread does a contiguous, cacheline aligned, chunk
+    const int chunk = 4096;
+#pragma omp parallel for
+    for (int i=0; i<n; i+=chunk)
+      saxpy_simd( std::min(chunk,n-i), a, x.data()+i, data()+i );
+  }
+};
+
+float Matrix::normf() const {
+  const int n = values().size();
+  return sqrt( sdot_simd( n,data(),data() ) );
+};
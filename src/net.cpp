@@ -15,6 +15,7 @@
 using std::cout;
 using std::endl;
 #include <fstream>
+#include <iomanip>
 
 #include <algorithm>
 #include <string>
@@ -25,6 +26,7 @@ using std::string;
 #include "vector.h"
 #include "net.h"
 #include "trace.h"
+#include "vmath.h"
 
 Net::Net(int s) { // Input vector size
     this->inR = s;
@@ -38,30 +40,7 @@ Net::Net( const Dataset &data ) {
   samples = 0;  
 }
 
-void Net::addLayer(int l, acFunc f) {
-  addLayer( l,
-	    apply_activation<VectorBatch>.at(f),
-	    activate_gradient<VectorBatch>.at(f) );
-
-    // int newR;
-    // // For the first layer we need the input row size,
-    // // for others we take the previous layer's row size
-    // if (this->layers.empty()) {
-    //     newR = this->inR; // Input's row size for the first layer
-    // } else {
-    //     newR = this->layers.back().output_size(); // Previous layer's row size
-    // }
-
-    // Layer layer(l, newR); // Initialize layer object and add the necessary parameters
-    
-    // layer.set_activation(f);                   // Activation function
-    // this->layers.push_back(layer);          // New layer added
-
-}
-void Net::addLayer( int l,
-		    std::function< void(const VectorBatch&,VectorBatch&) > apply_activation_batch,
-		    std::function< void(const VectorBatch&,VectorBatch&) > activate_gradient_batch
-		    ) {
+void Net::addLayer(int l, acFunc f, batch_layout layout) {
   try {
     int newR;
     // For the first layer we need the input row size,
@@ -72,23 +51,49 @@ void Net::addLayer( int l,
       newR = this->layers.back().output_size(); // Previous layer's row size
     }
     Layer layer(newR, l); // Initialize layer object and add the necessary parameters
-    layer.set_activation(apply_activation_batch,activate_gradient_batch);
+    // record the activation, so that the layer can use fused kernels
+    layer.set_activation(f);
+    layer.set_layout(layout);
     layer.layer_number = this->layers.size();
 #ifdef DEBUG
     cout << "Creating layer " << layer.layer_number << ": "
 	 << newR << "=>" << l << endl;
 #endif
-    this->layers.push_back(layer);
+    this->layers.push_back( std::move(layer) );
   } catch (std::string e ) {
     cout << "ERROR: <<" << e << ">> in adding layer " << l << endl;
   } catch (...) {
     throw( std::string("Error in addLayer") );
   }    
+
+    // int newR;
+    // // For the first layer we need the input row size,
+    // // for others we take the previous layer's row size
+    // if (this->layers.empty()) {
+    //     newR = this->inR; // Input's row size for the first layer
+    // } else {
+    //     newR = this->layers.back().output_size(); // Previous layer's row size
+    // }
+
+    // Layer layer(l, newR); // Initialize layer object and add the necessary parameters
+    
+    // layer.set_activation(f);                   // Activation function
+    // this->layers.push_back(layer);          // New layer added
+
+}
+void Net::addLayer( int l,
+		    std::function< void(const VectorBatch&,VectorBatch&) > apply_activation_batch,
+		    std::function< void(const VectorBatch&,VectorBatch&) > activate_gradient_batch
+		    ) {
+  // user functions: no fused kernels, every batch goes through std::function
+  const auto nlayers = layers.size();
+  addLayer( l,RELU );
+  if (layers.size()>nlayers)
+    layers.back().set_activation(apply_activation_batch,activate_gradient_batch);
 };
 
 void Net::set_lossfunction( lossfn lossFuncName ) {
-  lossFunction = lossFunctions.at(lossFuncName);
-  d_lossFunction = d_lossFunctions.at(lossFuncName);
+  loss_type = lossFuncName;
 };
 
 void Net::set_uniform_weights(float v) {
@@ -107,13 +112,26 @@ void Net::feedForward(const VectorBatch &input) {
     cout << "Feed forward batch of size " << input.batch_size() << endl;
   allocate_batch_specific_temporaries(input.batch_size());
 
-  this->layers.front().forward(input); // Forwarding the input
+  this->layers.front().forward(input,_approximation); // Forwarding the input
   for (unsigned i = 1; i < layers.size(); i++) {
-    this->layers.at(i).forward(this->layers.at(i - 1).activated_batch);
+    // the output of the previous layer, in its layout
+    this->layers.at(i - 1).with_output
+      ( [&] ( const auto &prev ) { this->layers.at(i).forward(prev,_approximation); } );
   }
 }
 //codesnippet end
 
+/*
+ * Single sample inference: one gemv per layer
+ * into the per-layer `activated' vectors; see output_vector.
+ */
+void Net::feedForward(const Vector &input) {
+  this->layers.front().forward(input,_approximation);
+  for (unsigned i = 1; i < layers.size(); i++) {
+    this->layers.at(i).forward(this->layers.at(i - 1).activated,_approximation);
+  }
+}
+
 
 void Net::show() {
     for (unsigned i = 0; i < layers.size(); i++) {
@@ -131,25 +149,24 @@ const VectorBatch &Net::outputs() const {
 }
 
 
-void Net::calculate_initial_delta(VectorBatch &input, VectorBatch &gTruth) {
-	VectorBatch d_loss = d_lossFunction( gTruth, input);
+/*
+ * The delta of the output layer, from its output and the labels.
+ * For a softmax layer with the cross entropy loss
+ * this is the output minus the labels, sample by sample,
+ * instead of a Jacobian per sample; see Layer::set_topdelta.
+ * The loss of the batch comes with it, see batch_loss.
+ */
+void Net::calculate_initial_delta( const VectorBatch &gTruth ) {
+  _batch_loss = layers.back().set_topdelta( gTruth,loss_type );
+}
 
-	if (layers.back().activation == 2 ) { // Softmax derivative function
-		Matrix jacobian( input.item_size(), input.item_size(), 0 );
-		for(int i = 0; i < input.batch_size(); i++ ) {
-		  auto one_column = input.get_vector(i);
-		  jacobian = smaxGrad_vec( one_column );
-		  Vector one_vector( jacobian.rowsize(), 0 );
-		  Vector one_grad = d_loss.get_vectorObj(i);
-		  jacobian.mvp( one_grad, one_vector );
-		  layers.back().d_activated_batch.set_vector(one_vector,i);
-		}
-	}
-	/* Will add the rest of the code here, not done yet
-	*/
+bool Net::softmax_cross_entropy() const {
+  return loss_type==cce and layers.back().softmax_output();
 }
 
 void Net::backPropagate(const VectorBatch &input, const VectorBatch &gTruth) {
+  if (inference_only())
+    throw(string("can not train a net that is inference only"));
 
   // VectorBatch delta = layers.back().activated_batch - gTruth;
   // delta.scaleby( 1.f / gTruth.batch_size() );
@@ -162,41 +179,47 @@ void Net::backPropagate(const VectorBatch &input, const VectorBatch &gTruth) {
   } else {
 
     if (trace_progress()) cout << "Layer-" << layers.back().layer_number << "\n";
-    layers.back().set_topdelta( gTruth );
-    const VectorBatch& prev = layers.at(layers.size() - 2).activated_batch;
-    layers.back().update_dw(layers.back().delta, prev);
+    calculate_initial_delta( gTruth );
+    // the batches of a hidden layer are in its layout, see Layer::with_output
+    layers.at(layers.size() - 2).with_output
+      ( [&] ( const auto &prev ) { layers.back().update_dw(layers.back().delta, prev); } );
 
 
     for (unsigned i = layers.size() - 2; i > 0; i--) {
       if (trace_progress()) cout << "Layer-" << layers.at(i).layer_number << "\n";
-      layers.at(i).backward
-	( layers.at(i+1).delta, layers.at(i+1).weights, layers.at(i-1).activated_batch);
+      layers.at(i+1).with_delta
+	( [&] ( const auto &next_delta ) {
+	  layers.at(i-1).with_output
+	    ( [&] ( const auto &prev ) {
+	      layers.at(i).backward( next_delta, layers.at(i+1).weights, prev ); } ); } );
     }
 
     if (trace_progress()) cout << "Layer-" << layers.at(0).layer_number << "\n";
-    layers.at(0).backward(layers.at(1).delta, layers.at(1).weights, input);
+    layers.at(1).with_delta
+      ( [&] ( const auto &next_delta ) {
+	layers.at(0).backward(next_delta, layers.at(1).weights, input); } );
 	
   }
 }
 
 void Net::SGD(float lr, float momentum) {
-	int samplesize = layers.at(0).activated_batch.batch_size();
+	// the output layer is sample major, see reserve_workspace
+	int samplesize = layers.back().activated_batch.batch_size();
     for (int i = 0; i < layers.size(); i++) {
-        // Normalize gradients to avoid exploding gradients
-		Matrix deltaW = layers.at(i).dw / samplesize;
-        Vector deltaB = layers.at(i).db / samplesize;
+        // Normalize gradients to avoid exploding gradients;
+		// dw / samplesize is evaluated inside the updates, without a temporary
+		const auto &dw = layers.at(i).dw; const auto &db = layers.at(i).db;
 
         // Gradient descent
         if (momentum > 0.0) {
-            layers.at(i).dw_velocity = momentum * layers.at(i).dw_velocity - lr * deltaW;
+            layers.at(i).dw_velocity = momentum * layers.at(i).dw_velocity - lr * ( dw / samplesize );
             //layers.at(i).weights = layers.at(i).weights + layers.at(i).dw_velocity;
 	    layers.at(i).weights.axpy( 1.f,layers.at(i).dw_velocity );
         } else {
-	  //layers.at(i).weights = layers.at(i).weights - lr * deltaW;
-	  layers.at(i).weights.axpy( -lr,deltaW );
+	  layers.at(i).weights = layers.at(i).weights - lr * ( dw / samplesize );
         }
 
-        layers.at(i).biases = layers.at(i).biases - lr * deltaB;
+        layers.at(i).biases = layers.at(i).biases - lr * ( db / samplesize );
 
         // Reset the values of delta sums
         layers.at(i).dw.zeros();
@@ -206,34 +229,22 @@ void Net::SGD(float lr, float momentum) {
 
 void Net::RMSprop(float lr, float momentum) {
     for (int i = 0; i < layers.size(); i++) {
-        // Get average over all the gradients
-        Matrix deltaWsq = layers.at(i).dw;
-        Vector deltaBsq = layers.at(i).db;
+        const auto &dw = layers.at(i).dw; const auto &db = layers.at(i).db;
        	
 	// Gradient step
-        deltaWsq.square(); // dW^2
-        deltaBsq.square(); // db^2
         // Sdw := m*Sdw + (1-m) * dW^2
+	layers.at(i).dw_velocity = momentum * layers.at(i).dw_velocity + (1 - momentum) * ( dw * dw );
+        layers.at(i).db_velocity = momentum * layers.at(i).db_velocity + (1 - momentum) * ( db * db );
 		
-	layers.at(i).dw_velocity = momentum * layers.at(i).dw_velocity + (1 - momentum) * deltaWsq;
-        layers.at(i).db_velocity = momentum * layers.at(i).db_velocity + (1 - momentum) * deltaBsq;
-		
-	Matrix sqrtSdw = layers.at(i).dw_velocity;
-        std::for_each(sqrtSdw.values().begin(), sqrtSdw.values().end(),
-		      [](auto &n) { 
-			n = sqrt(n);
-			if(n==0) n= 1-1e-7;
-		      });
-	Vector sqrtSdb = layers.at(i).db_velocity;
-        std::for_each(sqrtSdb.values().begin(), sqrtSdb.values().end(),
-		      [](auto &n) { 
+	auto root = [] (float n) -> float {
 			n = sqrt(n);
 			if(n==0) n= 1-1e-7;
-		      });
+			return n;
+		      };
 		
         // W := W - lr * dW / sqrt(Sdw)
-        layers.at(i).weights = layers.at(i).weights - lr * layers.at(i).dw / sqrtSdw;
-        layers.at(i).biases = layers.at(i).biases - lr * layers.at(i).db / sqrtSdb;
+        layers.at(i).weights = layers.at(i).weights - lr * dw / elementwise( root,layers.at(i).dw_velocity );
+        layers.at(i).biases = layers.at(i).biases - lr * db / elementwise( root,layers.at(i).db_velocity );
 			
         // Reset the values of delta sums
         layers.at(i).dw.zeros();
@@ -250,6 +261,8 @@ void Net::calcGrad(VectorBatch data, VectorBatch labels) {
 
 void Net::train( const Dataset &train_data,const Dataset &test_data,
 		 int epochs, int batchSize ) {
+    if (inference_only())
+      throw(string("can not train a net that is inference only"));
 
     const int Optimizer = optimizer();
     cout << "Optimizing with ";
@@ -259,13 +272,21 @@ void Net::train( const Dataset &train_data,const Dataset &test_data,
     }
 	
     std::vector<Dataset> batches = train_data.batch(batchSize);
+    // the loss and accuracy evaluation run the whole test set as one batch
+    const int maxbatch = std::max( batchSize,test_data.size() );
+    if (maxbatch>workspace_batch)
+      reserve_workspace(maxbatch);
+    cout << "Workspace: " << workspace_bytes()/1024 << " Kbytes"
+	 << " for batches up to " << workspace_batch << endl;
     float lrInit = learning_rate();
     const float momentum_value = momentum();
+    Evaluation eval;
 
     for (int i_epoch = 0; i_epoch < epochs; i_epoch++) {
       // Iterate through the entire dataset for each epoch
       cout << endl << "Epoch " << i_epoch+1 << "/" << epochs << endl;
       float current_learning_rate = lrInit; // Reset the learning rate to undo decay
+      float train_loss{0.f};
 
       for (int j = 0; j < batches.size(); j++) {
 	// Iterate through all batches within dataset
@@ -274,33 +295,178 @@ void Net::train( const Dataset &train_data,const Dataset &test_data,
 	cout << ".. batch " << j << "/" << batches.size() << " of size " << batch.size() << "\n";
 #endif
 	//	allocate_batch_specific_temporaries(batch.size());
-	feedForward(batch.inputs());
-	backPropagate(batch.inputs(),batch.labels());
-
-        // User chosen optimizer
         current_learning_rate = current_learning_rate / (1 + decay() * j);
-        optimize.at(Optimizer)(current_learning_rate, momentum_value); 
-		
+	train_step( batch, current_learning_rate, momentum_value );
+	train_loss += batch_loss() * batch.size();
       }
-      auto loss = calculateLoss(test_data);
-      cout << " Loss: " << loss << endl;
-      auto acc = accuracy(test_data);
-      cout << " Accuracy on trest set: " << acc << endl;
+      cout << " Training loss: " << train_loss / train_data.size() << endl;
+      evaluate(test_data,eval);
+      cout << " Loss: " << eval.loss << endl;
+      cout << " Accuracy on trest set: " << eval.accuracy << endl;
     }
 
 }
 
 /*
- * Resize temporaries to reflect current batch size
+ * One batch of the training loop: forward, backward, and optimizer update.
+ * After the first step with a given batch size this does no allocation,
+ * see test_alloc.cpp.
+ */
+void Net::train_step( const Dataset &batch, float lr, float momentum ) {
+  feedForward(batch.inputs());
+  backPropagate(batch.inputs(),batch.labels());
+  // User chosen optimizer
+  optimize.at(optimizer())(lr, momentum);
+}
+
+/*
+ * Resize temporaries to reflect current batch size.
+ * They live in the workspace, so this only sets sizes,
+ * unless the batch is larger than any before.
  */
 void Net::allocate_batch_specific_temporaries(int batchsize) {
 #ifdef DEBUG
   cout << "allocating temporaries for batch size " << batchsize << endl;
 #endif
+  if (batchsize>workspace_batch)
+    reserve_workspace(batchsize);
   for ( auto& layer : layers )
     layer.allocate_batch_specific_temporaries(batchsize);
 }
 
+/*
+ * One allocation for the batch temporaries of all layers,
+ * for batches of up to maxbatch samples.
+ * Training reserves for the larger of the batch size and the test set,
+ * so that no epoch allocates, and the footprint is known up front.
+ */
+void Net::reserve_workspace(int maxbatch) {
+  // the loss and the labels go by sample
+  if (not layers.empty() and layers.back().layout()!=sample_major)
+    throw(string("the output layer has to be sample major"));
+  if (inference_only()) {
+    // layer i only reads the output of layer i-1:
+    // two buffers for the widest layer suffice
+    int widest{0};
+    for ( const auto& layer : layers )
+      widest = std::max( widest,layer.output_size() );
+    // and a softmax layer keeps the log of its output, for the loss
+    const int n = widest*maxbatch;
+    int total = 2*Workspace::slice_size(n);
+    for ( const auto& layer : layers )
+      if (layer.softmax_output())
+	total += Workspace::slice_size( maxbatch*layer.output_size() );
+    workspace.reserve(total);
+    float *pingpong[2] = { workspace.carve(n),workspace.carve(n) };
+    for ( int i=0; i<layers.size(); i++ ) {
+      if (layers.at(i).layout()==feature_major)
+	layers.at(i).activated_by_feature.use_storage( pingpong[i%2],n );
+      else
+	layers.at(i).activated_batch.use_storage( pingpong[i%2],n );
+      if (layers.at(i).softmax_output())
+	layers.at(i).log_activated.use_workspace( workspace,maxbatch*layers.at(i).output_size() );
+    }
+  } else {
+    int total{0};
+    for ( const auto& layer : layers )
+      total += layer.workspace_size(maxbatch);
+    workspace.reserve(total);
+    for ( auto& layer : layers )
+      layer.use_workspace(workspace,maxbatch);
+  }
+  workspace_batch = maxbatch;
+  if (trace_progress())
+    cout << "Workspace of " << workspace_bytes() << " bytes for batches up to "
+	 << maxbatch << endl;
+}
+
+/*
+ * Inference only: drop the gradients, the optimizer state,
+ * and the backward temporaries of all layers,
+ * and let the activations alternate between two buffers.
+ * After this the net can only do feedForward;
+ * loadModel gives a net in this state.
+ */
+void Net::freeze() {
+  for ( auto& layer : layers )
+    if (not layer.frozen())
+      layer.freeze();
+  _inference_only = true;
+  if (workspace_batch>0)
+    reserve_workspace(workspace_batch);
+}
+
+/*
+ * The cheapest exponential in the sigmoid and softmax
+ * that keeps their outputs within max_error; see vmath.h.
+ * Only for inference: the training would follow the error.
+ * The degree is passed down the forward sweep of this net only,
+ * so nets with different settings can run side by side.
+ */
+void Net::set_approximation( float max_error ) {
+  if (not inference_only())
+    throw(string("approximate activations are only for a net that is inference only"));
+  _approximation = ( max_error>0.f ? exp_approximation_for(max_error) : 0 );
+  if (trace_progress())
+    cout << "Activations to within " << max_error << ": exponential of degree "
+	 << _approximation << endl;
+}
+
+/*
+ * Run the dataset through the net with the accurate activations
+ * and with the current approximation, and compare;
+ * to sign off on set_approximation for a model.
+ */
+ApproximationCheck Net::check_approximation( const Dataset &data ) {
+  ApproximationCheck check;
+  check.degree = _approximation;
+  check.samples = data.size();
+
+  const int approximation = _approximation;
+  _approximation = 0;
+  check.exact_accuracy = accuracy(data);
+  const VectorBatch exact = outputs(); // a copy: the next sweep overwrites them
+  _approximation = approximation;
+  check.approximate_accuracy = accuracy(data);
+  const VectorBatch &approximate = outputs();
+
+  const int n = exact.item_size();
+  for ( int s=0; s<exact.batch_size(); s++ ) {
+    const float *e = exact.data(s*n), *a = approximate.data(s*n);
+    for ( int i=0; i<n; i++ )
+      check.max_output_difference =
+	std::max( check.max_output_difference,std::abs( e[i]-a[i] ) );
+    if ( std::max_element(e,e+n)-e != std::max_element(a,a+n)-a )
+      check.changed_predictions++;
+  }
+  return check;
+}
+
+std::ostream &operator<<( std::ostream &os,const ApproximationCheck &check ) {
+  os << "exponential of degree " << check.degree
+     << ": accuracy " << check.exact_accuracy << " -> " << check.approximate_accuracy
+     << ", " << check.changed_predictions << " of " << check.samples << " predictions changed"
+     << ", outputs at most " << check.max_output_difference << " apart";
+  return os;
+}
+
+/*
+ * Sum of the loss over all elements of a batch,
+ * instantiated per loss so that the loss itself is inlined.
+ */
+template< typename Loss >
+static float summed_loss( const VectorBatch &result,const VectorBatch &labels ) {
+  const float *r = result.data(), *l = labels.data();
+  float loss{0.f};
+  for (int i=0; i<result.size(); i++) {
+    assert( not std::isnan(l[i]) );
+    assert( not std::isnan(r[i]) );
+    loss += Loss::value( l[i],r[i] );
+  }
+  assert( not std::isnan(loss) );
+  return loss;
+}
+
 /*!
  * Calculate the los function as sum of losses
  * of the individual data point.
@@ -313,27 +479,33 @@ float Net::calculateLoss(const Dataset &testSplit) {
 #endif
   //  allocate_batch_specific_temporaries(testSplit.inputs().batch_size());
   feedForward(testSplit.inputs());
+  return output_loss( testSplit.labels() );
+}
+
+/*
+ * The loss per sample of the outputs of the last feedForward
+ */
+float Net::output_loss( const VectorBatch &tmp_labels ) const {
   const VectorBatch &result = outputs();
   assert( result.notnan() );
 
     float loss = 0.0;
-    auto tmp_labels =  testSplit.labels();
     if (trace_arrays()) {
       cout << "Compare results\n"; result.show();
       cout << " to label\n"; tmp_labels.show();
     }
-    for (int vec=0; vec<result.batch_size(); vec++) { // iterate over all items
-      const auto& one_result = result.extract_vector(vec); // VLE figure out const span !!!
-      auto one_label  = tmp_labels.get_vector(vec);
-      assert( one_result.size()==one_label.size() );
-      for (int i=0; i<one_result.size(); i++) { // Calculate loss of result
-	auto this_label = one_label[i], this_result = one_result[i];
-	assert( not std::isnan(this_label) );
-	assert( not std::isnan(this_result) );
-	auto oneloss = lossFunction( this_label, this_result );
-	assert( not std::isnan(oneloss) );
-	loss += oneloss;
-      }
+    const int n = result.item_size();
+    assert( tmp_labels.item_size()==n );
+    if (softmax_cross_entropy()) {
+      // - sum label log p, with the log computed as logit - log sum exp logits,
+      // so it is finite even where p is below the clipping of the softmax
+      const float *logp = layers.back().log_activated.data(), *labels = tmp_labels.data();
+      for (int i=0; i<result.size(); i++)
+	loss -= labels[i]*logp[i];
+    } else {
+      // items are stored contiguously, so this is one sweep over the batch
+      with_loss( loss_type,[&] ( auto lossf ) {
+	  loss = summed_loss<decltype(lossf)>( result,tmp_labels ); } );
     }
     const int bs = result.batch_size();
     assert( bs>0 );
@@ -354,6 +526,23 @@ float Net::calculateLoss(const Dataset &testSplit) {
 #else
 #endif
 
+/*
+ * Is the largest output where the label has its one?
+ * This is Categorization::normalize followed by close_enough,
+ * on the values in place.
+ */
+static bool top_category_matches( const float *result, const float *label, int n ) {
+  const int imax = std::max_element( result,result+n ) - result;
+  for ( int i=0; i<n; i++ ) {
+    const float p = ( i==imax ? 1.f : 0.f ), l = label[i];
+    if ( not ( ( p==l )
+	       or ( l==0. and std::abs(p)<1.e-5 )
+	       or ( std::abs( (p-l)/l )<1.e-5 ) ) )
+      return false;
+  }
+  return true;
+}
+
 float Net::accuracy( const Dataset &test_set ) {
   if (trace_progress())
     cout << "Accuracy calculation\n";
@@ -378,11 +567,10 @@ float Net::accuracy( const Dataset &test_set ) {
       }
       assert( output.notnan() );
 
+      const int n = output.item_size();
+      assert( test_labels.item_size()==n );
       for(int idx=0; idx < output.batch_size(); idx++ ) {
-	Vector oneItem = output.get_vectorObj(idx);
-	Categorization result( oneItem );
-	result.normalize();
-	if ( result.close_enough( test_labels.extract_vector(idx) ) ) {
+	if ( top_category_matches( output.data(idx*n),test_labels.data(idx*n),n ) ) {
 	  correct++;
 	} else {
 	  incorrect++;
@@ -394,6 +582,72 @@ float Net::accuracy( const Dataset &test_set ) {
     return acc;
 }
 
+/*
+ * One forward sweep, then the loss over the whole batch
+ * and one pass over the samples for the accuracy and the confusion matrix.
+ */
+Evaluation Net::evaluate( const Dataset &test_set ) {
+  Evaluation eval;
+  evaluate( test_set,eval );
+  return eval;
+}
+
+void Net::evaluate( const Dataset &test_set,Evaluation &eval ) {
+  if (trace_progress())
+    cout << "Evaluation\n";
+
+  assert( test_set.size()>0 );
+  const auto& test_inputs = test_set.inputs();
+  const auto& test_labels = test_set.labels();
+  assert( test_inputs.batch_size()==test_labels.batch_size() );
+  feedForward(test_inputs);
+
+  eval.loss = output_loss( test_labels );
+  const VectorBatch& output = outputs();
+  const int n = output.item_size();
+  eval.samples = output.batch_size();
+  eval.classes = n;
+  eval.confusion.assign( n*n,0 );
+  int correct = 0;
+  for(int idx=0; idx < output.batch_size(); idx++ ) {
+    const float *result = output.data(idx*n), *label = test_labels.data(idx*n);
+    if ( top_category_matches( result,label,n ) )
+      correct++;
+    const int predicted = std::max_element( result,result+n ) - result,
+      labeled = std::max_element( label,label+n ) - label;
+    eval.confusion[ labeled*n+predicted ]++;
+  }
+  eval.accuracy = static_cast<float>( correct ) / static_cast<float>( eval.samples );
+}
+
+float Evaluation::precision( int c ) const {
+  int predicted = 0;
+  for ( int l=0; l<classes; l++ )
+    predicted += count(l,c);
+  return ( predicted==0 ? 0.f : count(c,c) / static_cast<float>(predicted) );
+}
+
+float Evaluation::recall( int c ) const {
+  int labeled = 0;
+  for ( int p=0; p<classes; p++ )
+    labeled += count(c,p);
+  return ( labeled==0 ? 0.f : count(c,c) / static_cast<float>(labeled) );
+}
+
+std::ostream &operator<<( std::ostream &os,const Evaluation &eval ) {
+  os << "loss " << eval.loss << ", accuracy " << eval.accuracy
+     << " on " << eval.samples << " samples\n"
+     << "class precision recall | confusion: predicted class by column\n";
+  for ( int c=0; c<eval.classes; c++ ) {
+    os << std::setw(5) << c << " " << std::setw(9) << eval.precision(c)
+       << " " << std::setw(6) << eval.recall(c) << " |";
+    for ( int p=0; p<eval.classes; p++ )
+      os << " " << std::setw(5) << eval.count(c,p);
+    os << "\n";
+  }
+  return os;
+}
+
 
 
 void Net::saveModel(std::string path){
@@ -409,14 +663,17 @@ void Net::saveModel(std::string path){
 	float temp;
 	int no_layers = layers.size();
 	file.write( reinterpret_cast<char *>(&no_layers), sizeof(no_layers) ); 
-	for ( auto l : layers ) {
+	for ( const auto& l : layers ) {
 		int insize = l.input_size(), outsize = l.output_size();
 		file.write(	reinterpret_cast<char *>(&outsize), sizeof(int) );
 		file.write(	reinterpret_cast<char *>(&insize), sizeof(int) );
-		file.write( reinterpret_cast<char *>(&l.activation), sizeof(int) );
+		file.write( reinterpret_cast<const char *>(&l.activation), sizeof(int) );
 		
+		// row by row, leaving out the padding
 		const auto& weights = l.weights;
-		file.write(reinterpret_cast<const char *>(weights.data()), sizeof(float)*weights.nelements());
+		for ( int row=0; row<outsize; row++ )
+			file.write(reinterpret_cast<const char *>(weights.data()+row*weights.leading_dimension()),
+				   sizeof(float)*insize);
 		// const float* weights_data = l.weights.data();
 		// file.write(reinterpret_cast<char *>(&weights_data), sizeof(temp)*insize*outsize);
 
@@ -443,25 +700,35 @@ void Net::loadModel(std::string path){
 		file.read( reinterpret_cast<char *>(&outsize), sizeof(int) );
 		file.read( reinterpret_cast<char *>(&insize), sizeof(int) );
 	
-		file.read( reinterpret_cast<char *>(&layers[i].activation), sizeof(int) );
+		acFunc activation;
+		file.read( reinterpret_cast<char *>(&activation), sizeof(int) );
+		layers[i].set_activation(activation);
+		layers[i].layer_number = i;
+		layers[i].activated = Vector( outsize, 0 );
 
-		layers[i].weights = Matrix( outsize, insize, 0 );
+		layers[i].weights = Matrix( outsize, insize, 0, true );
 		float *w_data = layers[i].weights.data();
-		file.read(reinterpret_cast<char *>( w_data ), //(&layers[i].weights.mat[0]), 
-			  sizeof(temp) * insize*outsize);
+		for ( int row=0; row<outsize; row++ )
+			file.read(reinterpret_cast<char *>( w_data+row*layers[i].weights.leading_dimension() ),
+				  sizeof(temp) * insize);
 
 		layers[i].biases = Vector( outsize, 0 );
 		float *b_data = layers[i].biases.data();
 		file.read(reinterpret_cast<char *>( b_data ), //(&layers[i].biases.vals[0]), 
 			  sizeof(temp) * layers[i].biases.size());
 	}
+	if (no_layers>0)
+		inR = layers.front().input_size();
+	// a loaded model is for inference: there is no optimizer state
+	workspace_batch = 0;
+	freeze();
 }
 
 
 void Net::info() {
 	cout << "Model info\n---------------\n";
 
-	for ( auto l : layers ) {
+	for ( const auto& l : layers ) {
 		cout << "Weights: " << l.output_size() << " x " << l.input_size() << "\n";
 		cout << "Biases: " << l.biases.size() << "\n";
 		
@@ -469,10 +736,21 @@ void Net::info() {
 			case RELU: cout << "RELU\n"; break;
 			case SIG: cout << "Sigmoid\n"; break;
 			case SMAX: cout << "Softmax\n"; break;
+			case TANH: cout << "Tanh\n"; break;
+			case GELU: cout << "GELU\n"; break;
+			case SILU: cout << "SiLU\n"; break;
+			case ELU: cout << "ELU\n"; break;
 			case NONE: break;
 		}
 		cout << "---------------\n";
 	}
+	if (workspace_batch>0)
+		cout << "Workspace: " << workspace_bytes() << " bytes for batches up to "
+		     << workspace_batch << "\n";
+	if (inference_only())
+		cout << "Inference only\n";
+	if (approximation()>0)
+		cout << "Approximate activations: exponential of degree " << approximation() << "\n";
 
 }
 
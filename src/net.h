@@ -14,6 +14,7 @@
 #ifndef CODE_NET_H
 #define CODE_NET_H
 
+#include <iosfwd>
 #include <vector>
 #include "vector.h"
 #include "matrix.h"
@@ -23,22 +24,50 @@
 
 enum opt{sgd, rms}; // Gradient descent, RMSprop
 
+/*
+ * The approximate activations against the accurate ones
+ * on a dataset, see Net::check_approximation
+ */
+struct ApproximationCheck {
+  int degree{0}; // of the exponential, see Net::set_approximation
+  int samples{0};
+  float exact_accuracy{0.f}, approximate_accuracy{0.f};
+  int changed_predictions{0}; // samples with a different top category
+  float max_output_difference{0.f};
+};
+std::ostream &operator<<( std::ostream&,const ApproximationCheck& );
+
+/*
+ * Loss, accuracy and confusion matrix of a dataset,
+ * from one forward sweep, see Net::evaluate.
+ * The class of a sample is the largest output, or the largest label;
+ * the accuracy is the same as Net::accuracy.
+ */
+struct Evaluation {
+  int samples{0}, classes{0};
+  float loss{0.f}, accuracy{0.f};
+  std::vector<int> confusion; // classes x classes, by label, then prediction
+  int count( int label,int predicted ) const { return confusion.at( label*classes+predicted ); };
+  // of the samples predicted c, the fraction labeled c; zero if there are none
+  float precision( int c ) const;
+  // of the samples labeled c, the fraction predicted c; zero if there are none
+  float recall( int c ) const;
+};
+std::ostream &operator<<( std::ostream&,const Evaluation& );
+
 class Net {
 private:
     int inR; // input dimensions
     int inC;
     int samples;
     std::vector<Layer> layers;
-    std::function<float( const float& groundTruth, const float& result)> lossFunction{
-      [] ( const float& groundTruth, const float& result) -> float {
-	throw(std::string("no loss function defined")); } };
-    std::function<VectorBatch( VectorBatch& groundTruth, VectorBatch& result )> d_lossFunction{
-      [] ( VectorBatch& groundTruth, VectorBatch& result ) -> VectorBatch {
-	throw(std::string("no d_lossfunction defined")); } };
+    lossfn loss_type{mse}; // dispatched with with_loss, see funcs.h
 public:
     Net(int s); // input shape
     Net( const Dataset &d );
-    void addLayer(int l, acFunc activation); // length of the dense layer
+    // length of the dense layer; a hidden layer with an elementwise activation
+    // can keep its batches feature major, see batch_layout in vector2.h
+    void addLayer(int l, acFunc activation, batch_layout layout=sample_major);
     void addLayer( int l,
 		   std::function< void(const VectorBatch&,VectorBatch&) > apply_activation_batch,
 		   std::function< void(const VectorBatch&,VectorBatch&) > activate_gradient_batch
@@ -56,13 +85,35 @@ public:
     void feedForward( const VectorBatch& );
 
     void allocate_batch_specific_temporaries(int batchsize);
+    void reserve_workspace(int maxbatch);
+    long workspace_bytes() const { return workspace.bytes(); };
+    int workspace_batch_size() const { return workspace_batch; };
+    void freeze();
+    bool inference_only() const { return _inference_only; };
+    // sigmoid and softmax outputs at most max_error off, for a frozen net;
+    // max_error zero for the accurate ones
+    void set_approximation( float max_error );
+    int approximation() const { return _approximation; };
+    ApproximationCheck check_approximation( const Dataset& );
+private:
+    // all batch temporaries of the layers, see reserve_workspace
+    Workspace workspace;
+    int workspace_batch{0};
+    bool _inference_only{false};
+    int _approximation{0};
+    float _batch_loss{0.f};
+public:
     void calcGrad(Dataset data);
     void calcGrad(VectorBatch data, VectorBatch labels);
 
     void backPropagate(const Vector &input, const Vector &gTruth);
     void backPropagate(const VectorBatch &input, const VectorBatch &gTruth);
 	
-    void calculate_initial_delta( VectorBatch& result, VectorBatch& gTruth);
+    void calculate_initial_delta( const VectorBatch& gTruth );
+    //! loss of the last batch in backPropagate, from the same sweep as its top delta
+    float batch_loss() const { return _batch_loss; };
+    //! softmax output with cross entropy: loss and top delta from the log-sum-exp
+    bool softmax_cross_entropy() const;
 
     void SGD(float lr, float momentum);
     void RMSprop(float lr, float momentum);
@@ -96,11 +147,19 @@ public:
   };
 	
   void train( const Dataset& train,const Dataset& test, int epochs, int batchSize);
+  void train_step( const Dataset& batch, float lr, float momentum );
 #if MPINN
     void trainmpi(Dataset &trainData, Dataset &testData, float lr, int epochs, opt Optimizer, lossfn lossFunc, int batchSize, float momentum = 0.0, float decay = 0.0);
 #endif
     float calculateLoss(const Dataset &testSplit);
     float accuracy( const Dataset& valSet );
+    // loss and accuracy together, with one forward sweep instead of two
+    Evaluation evaluate( const Dataset& valSet );
+    // the same, reusing the confusion matrix of eval: no allocation after the first
+    void evaluate( const Dataset& valSet,Evaluation &eval );
+private:
+    float output_loss( const VectorBatch &labels ) const;
+public:
 
 
 	void saveModel(std::string path);
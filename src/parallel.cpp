@@ -0,0 +1,19 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of 
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code 
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "parallel.h"
+
+static int threshold{32768};
+
+void set_parallel_threshold(int n) { threshold = n; };
+int parallel_threshold() { return threshold; };
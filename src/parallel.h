@@ -0,0 +1,25 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of 
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code 
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_PARALLEL_H
+#define SRC_PARALLEL_H
+
+/*
+ * OpenMP loops are only run in parallel
+ * if they touch at least this many elements;
+ * tiny networks are faster on a single thread.
+ */
+int  parallel_threshold();
+void set_parallel_threshold(int);
+
+#endif //SRC_PARALLEL_H
@@ -0,0 +1,43 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_SIMD_H
+#define SRC_SIMD_H
+
+/*
+ * Hand-vectorized kernels for the `_impl_simd.cpp' implementation.
+ *
+ * All kernels are compiled for every instruction set we know about;
+ * which one is used is decided once, at the first call,
+ * by querying the processor.
+ * The choice can be lowered (not raised) for testing
+ * by setting the environment variable EDUDL_SIMD
+ * to one of: generic, sse, avx2, avx512.
+ */
+enum class simd_isa { generic, sse, avx2, avx512 };
+simd_isa simd_level();
+const char *simd_name( simd_isa );
+
+// y <- y + a x
+void  saxpy_simd( int n,float a,const float *x,float *y );
+// y <- a x
+void  sscal2_simd( int n,float a,const float *x,float *y );
+// x^t y
+float sdot_simd( int n,const float *x,const float *y );
+/*
+ * y <- A x or y <- A^t x
+ * with A an m x n matrix stored by rows, with leading dimension lda
+ */
+void  sgemv_simd( bool trans,int m,int n,const float *a,int lda,const float *x,float *y );
+
+#endif //SRC_SIMD_H
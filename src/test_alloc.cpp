@@ -0,0 +1,247 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "net.h"
+#include "dataset.h"
+#include "vector.h"
+#include "funcs.h"
+#include "blas.h"
+
+using namespace std;
+
+/*
+ * Count the heap allocations during training.
+ * Some setup is done once per program: the choice of blas backend,
+ * the packing buffers of the gemm, the OpenMP threads;
+ * a first configuration is trained unreported to get that out of the way.
+ * After that, with the workspace reserved for the batch size,
+ * not even the first training step should allocate,
+ * and an epoch of Net::train, which adds the loss and accuracy evaluation,
+ * should not allocate beyond setting up the batches.
+ * Splitting and batching a dataset make views, without copying the data.
+ * Net::evaluate gives the loss and accuracy of calculateLoss and accuracy,
+ * and with an Evaluation to reuse it does not allocate either.
+ * Every C++ allocation goes through the operator new below.
+ */
+static atomic<long> allocations{0}, allocated_bytes{0};
+
+void *operator new( size_t n ) {
+  allocations++; allocated_bytes += n;
+  if ( void *p = malloc( n>0 ? n : 1 ) )
+    return p;
+  throw bad_alloc();
+}
+void *operator new( size_t n,align_val_t a ) {
+  allocations++; allocated_bytes += n;
+  const size_t al = static_cast<size_t>(a);
+  if ( void *p = aligned_alloc( al, ( (n+al-1)/al )*al ) )
+    return p;
+  throw bad_alloc();
+}
+// not inlined: gcc would see the free next to the new of the caller,
+// and warn that they do not match (-Wmismatched-new-delete)
+[[gnu::noinline]] void operator delete( void *p ) noexcept { free(p); }
+// the sized and aligned forms: malloc and aligned_alloc both go to free
+void operator delete( void *p,size_t ) noexcept { operator delete(p); }
+void operator delete( void *p,align_val_t ) noexcept { operator delete(p); }
+void operator delete( void *p,size_t,align_val_t ) noexcept { operator delete(p); }
+
+//! allocations and bytes done by f
+template< typename F >
+pair<long,long> count_allocations( F f ) {
+  const long n0 = allocations, b0 = allocated_bytes;
+  f();
+  return { allocations-n0, allocated_bytes-b0 };
+}
+
+/*
+ * Three classes, depending on which third of the input is largest
+ */
+static Dataset three_classes( int nitems,int insize ) {
+  Dataset data(3);
+  for ( int item=0; item<nitems; item++ ) {
+    vector<float> in(insize), out(3,0.f);
+    for ( auto& e : in )
+      e = rand()/static_cast<float>(RAND_MAX);
+    int best{0};
+    for ( int i=0; i<insize; i++ )
+      if (in[i]>in[best]) best = i;
+    out.at( 3*best/insize ) = 1.f;
+    data.push_back( dataItem{in,out} );
+  }
+  return data;
+}
+
+/*
+ * Train one configuration; return whether it stays off the allocator.
+ * With report==false only go through the motions.
+ */
+static bool check_configuration( int opt,float momentum,bool report ) {
+  const int insize = 12, batchsize = 16;
+  srand(17);
+  // the last batch is smaller than the others
+  auto data = three_classes( 150,insize );
+  auto [split_allocations,split_bytes] = count_allocations
+    ( [&] () { auto s = data.split(.8); } );
+  auto [train_data,test_data] = data.split(.8);
+
+  Net net(data);
+  net.addLayer(24,RELU);
+  net.addLayer(16,SIG);
+  net.addLayer(3,SIG);
+  net.set_lossfunction(mse);
+  net.set_optimizer(opt);
+  net.set_momentum(momentum);
+  net.set_learning_rate(.01);
+
+  // only the list of batches is allocated, not their data
+  std::vector<Dataset> batches;
+  auto [batch_allocations,batch_bytes] = count_allocations
+    ( [&] () { batches = train_data.batch(batchsize); } );
+  const bool views = split_bytes==0
+    and batch_bytes<=static_cast<long>( 2*batches.size()*sizeof(Dataset) );
+
+  // all batch temporaries are in the workspace
+  net.reserve_workspace(batchsize);
+  auto [steps,step_bytes] = count_allocations
+    ( [&] () {
+      for ( const auto& b : batches )
+	net.train_step( b,net.learning_rate(),momentum );
+    } );
+  if (not report) return true;
+
+  // extra epochs of train should not add any allocations;
+  // the first call grows the workspace to the test set
+  net.train( train_data,test_data,1,batchsize );
+  const long workspace = net.workspace_bytes();
+  auto [short_run,short_bytes] = count_allocations
+    ( [&] () { net.train( train_data,test_data,1,batchsize ); } );
+  auto [long_run,long_bytes] = count_allocations
+    ( [&] () { net.train( train_data,test_data,3,batchsize ); } );
+
+  const bool ok = views and step_bytes==0 and long_bytes==short_bytes
+    and net.workspace_bytes()==workspace;
+  cout << ( opt==sgd ? "SGD" : "RMSprop" ) << ", momentum " << momentum << ": "
+       << steps << " allocations (" << step_bytes << " bytes) in "
+       << batches.size() << " steps; train: "
+       << short_run << " allocations for 1 epoch, "
+       << long_run << " for 3 epochs; workspace "
+       << workspace << " bytes; split "
+       << split_bytes << " bytes, batch " << batch_bytes << " bytes"
+       << ( ok ? "" : "  <== FAILED" ) << "\n";
+  return ok;
+}
+
+/*
+ * evaluate against calculateLoss and accuracy, which do the same forward sweep:
+ * the numbers are equal, not just close.
+ * The confusion matrix counts every sample once,
+ * and the net gives the same loss after it is frozen,
+ * also with large weights, where the softmax is clipped.
+ */
+static bool check_evaluation( acFunc last,lossfn loss ) {
+  const int insize = 12;
+  srand(17);
+  auto data = three_classes( 150,insize );
+  auto [train_data,test_data] = data.split(.8);
+
+  Net net(data);
+  net.addLayer(24,RELU);
+  net.addLayer(3,last);
+  net.set_lossfunction(loss);
+  net.set_learning_rate(.01);
+  for ( const auto& b : train_data.batch(16) )
+    net.train_step( b,net.learning_rate(),0.f );
+
+  const float separate_loss = net.calculateLoss(test_data),
+    separate_accuracy = net.accuracy(test_data);
+  Evaluation eval = net.evaluate(test_data);
+  int counted{0};
+  for ( auto c : eval.confusion )
+    counted += c;
+  auto [reuse_allocations,reuse_bytes] = count_allocations
+    ( [&] () { net.evaluate( test_data,eval ); } );
+  for ( auto &w : net.at(1).weight_values().values() )
+    w *= 100.f;
+  const float large_loss = net.calculateLoss(test_data);
+  net.freeze();
+  const float frozen_loss = net.calculateLoss(test_data);
+
+  const bool ok = eval.loss==separate_loss and eval.accuracy==separate_accuracy
+    and eval.samples==test_data.size() and counted==eval.samples
+    and reuse_allocations==0 and frozen_loss==large_loss;
+  cout << ( last==SMAX ? "softmax, cross entropy" : "sigmoid, squared error" )
+       << ": evaluate loss " << eval.loss << " vs " << separate_loss
+       << ", accuracy " << eval.accuracy << " vs " << separate_accuracy
+       << "; confusion matrix counts " << counted << " of " << test_data.size()
+       << " samples; " << reuse_allocations << " allocations reusing it"
+       << "; with large weights loss " << large_loss << ", frozen " << frozen_loss
+       << ( ok ? "" : "  <== FAILED" ) << "\n";
+  return ok;
+}
+
+/*
+ * Views never write their parent: a write, or growing a slice,
+ * copies the values first.
+ */
+static bool check_views() {
+  srand(17);
+  auto data = three_classes( 10,6 );
+  const auto parent = data.inputs();
+
+  VectorBatchView view( data.inputs(),2,3 );
+  view.data()[0] += 1.f;
+  auto slice = data.slice(2,3);
+  slice.push_back( dataItem{ vector<float>(6,1.f),vector<float>{1.f,0.f,0.f} } );
+
+  const bool ok = std::equal( parent.data(),parent.data()+parent.size(),data.inputs().data() )
+    and view.data()[0]==data.inputs().data(2*6)[0]+1.f
+    and data.size()==10 and slice.size()==4
+    and slice.inputs().data(3*6)[0]==1.f;
+  cout << "Writing to a view " << ( ok ? "copies it" : "changes the parent  <== FAILED" ) << "\n";
+  return ok;
+}
+
+int main() {
+
+  int failures{0};
+  cout << "blas: " << blas_backend() << "\n";
+  if (not check_views())
+    failures++;
+  check_configuration( sgd,0.f,false );
+
+  for ( int opt : { sgd,rms } ) {
+    for ( float momentum : { 0.f,.9f } ) {
+      if (not check_configuration( opt,momentum,true ))
+	failures++;
+    }
+  }
+
+  for ( auto [last,loss] : { pair<acFunc,lossfn>{SIG,mse},pair<acFunc,lossfn>{SMAX,cce} } )
+    if (not check_evaluation( last,loss ))
+      failures++;
+
+  if (failures>0) {
+    cout << failures << " checks failed\n";
+    return 1;
+  }
+  cout << "Training does not allocate in the steady state\n";
+  return 0;
+}
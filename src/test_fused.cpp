@@ -0,0 +1,216 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "vector2.h"
+#include "vector.h"
+#include "matrix.h"
+#include "funcs.h"
+#include "blas.h"
+#include "blas_panels.h"
+
+using namespace std;
+
+/*
+ * The fused layer products against the unfused operations they replace:
+ *   forward   v2mp_bias_act   = v2mp, addh, apply_activation_io
+ *   backward  v2mtp_act_grad  = v2mtp, activate_gradient_io, hadamard
+ * for every activation, through the dispatch of blas.h,
+ * through the fused kernels of every backend that is built,
+ * and through the panels of blas_panels.h on top of the reference gemm;
+ * the softmax derivative is not elementwise, and the fused one is that of NONE.
+ * The sizes are not multiples of the micro tiles or of the panel width,
+ * so that the last tile and the last panel are partial.
+ * The forward product is also checked with every approximate exponential.
+ *
+ * Both sides do the same arithmetic, in a different order,
+ * so an element passes if it is within 1e-5 (1+|y|) of the unfused one.
+ */
+
+static const float tolerance = 1.e-5f;
+
+// the largest error of y against the unfused z, as a fraction of the tolerance
+static float error_ratio( const VectorBatch &y,const VectorBatch &z ) {
+  float worst{0.f};
+  for (int i=0; i<z.size(); i++) {
+    const float e = fabs( y.data()[i]-z.data()[i] )/( tolerance*( 1.f+fabs(z.data()[i]) ) );
+    worst = ( e>worst or std::isnan(e) ? e : worst );
+  }
+  return worst;
+}
+
+using forward_function = function< void
+  ( const VectorBatch&,const Matrix&,const Vector&,acFunc,int,VectorBatch& ) >;
+using backward_function = function< void
+  ( const VectorBatch&,const Matrix&,const VectorBatch&,acFunc,VectorBatch& ) >;
+
+/*
+ * The fused products as VectorBatch calls them,
+ * see v2mp_bias_act and v2mtp_act_grad in vectorbatch_impl_reference.cpp,
+ * with a given kernel
+ */
+template< typename BiasAct >
+forward_function forward_with( BiasAct bias_act ) {
+  return [bias_act] ( const VectorBatch &x,const Matrix &w,const Vector &b,
+		      acFunc f,int approximation,VectorBatch &y ) {
+    bias_act( true,false, y.item_size(),y.batch_size(),w.colsize(),
+	      w.values().data(),w.leading_dimension(),
+	      x.data(),x.item_size(),
+	      y.data(),y.item_size(),
+	      b.data(),f,approximation );
+  };
+}
+template< typename ActGrad >
+backward_function backward_with( ActGrad act_grad ) {
+  return [act_grad] ( const VectorBatch &d,const Matrix &w,const VectorBatch &a,
+		      acFunc f,VectorBatch &y ) {
+    act_grad( false,false, y.item_size(),y.batch_size(),w.rowsize(),
+	      w.values().data(),w.leading_dimension(),
+	      d.data(),d.item_size(),
+	      y.data(),y.item_size(),
+	      a.data(),f );
+  };
+}
+
+struct candidate {
+  string name; forward_function forward; backward_function backward;
+  int products{0},failures{0}; float worst{0.f};
+};
+
+static vector<candidate> candidates() {
+  vector<candidate> list;
+  list.push_back
+    ( { "VectorBatch",
+	[] ( const VectorBatch &x,const Matrix &w,const Vector &b,acFunc f,int approximation,
+	     VectorBatch &y ) { x.v2mp_bias_act( w,b,f,y,approximation ); },
+	[] ( const VectorBatch &d,const Matrix &w,const VectorBatch &a,acFunc f,
+	     VectorBatch &y ) { d.v2mtp_act_grad( w,a,f,y ); } } );
+  vector<const blas_kernels*> backends{ &blas_reference_kernels,&blas_simd_kernels };
+#ifdef BLISNN
+  backends.push_back( &blas_blis_kernels );
+#endif
+#ifdef USE_CBLAS
+  backends.push_back( &blas_cblas_kernels );
+#endif
+  for ( auto k : backends )
+    list.push_back
+      ( { string("blas ")+k->name,forward_with( k->gemm_bias_act ),backward_with( k->gemm_act_grad ) } );
+  // the panels with any gemm, also when no library is built
+  const auto gemm = blas_reference_kernels.gemm;
+  list.push_back
+    ( { "blas_panels",
+	forward_with
+	( [gemm] ( bool ta,bool tb,int m,int n,int k, const float *a,int lda,const float *b,int ldb,
+		   float *c,int ldc, const float *bias,acFunc f,int approximation ) {
+	  blas_panels_bias_act( gemm, ta,tb,m,n,k, a,lda, b,ldb, c,ldc, bias,f,approximation ); } ),
+	backward_with
+	( [gemm] ( bool ta,bool tb,int m,int n,int k, const float *a,int lda,const float *b,int ldb,
+		   float *c,int ldc, const float *act,acFunc f ) {
+	  blas_panels_act_grad( gemm, ta,tb,m,n,k, a,lda, b,ldb, c,ldc, act,f ); } ) } );
+  return list;
+}
+
+static const char *name( acFunc f ) {
+  switch (f) {
+  case RELU : return "relu";
+  case SIG  : return "sigmoid";
+  case SMAX : return "softmax";
+  case NONE : return "none";
+  case TANH : return "tanh";
+  case GELU : return "gelu";
+  case SILU : return "silu";
+  default   : return "elu";
+  }
+}
+
+static void record
+    ( candidate &c,float worst,const string &what,acFunc f,int in,int out,int batch ) {
+  c.products++;
+  c.worst = std::max( c.worst,worst );
+  if (not ( worst<=1.f ) and c.failures++<5)
+    cout << c.name << " " << what << " fails for " << name(f)
+	 << ", " << in << "->" << out << " batch " << batch
+	 << ": error " << worst << " of the tolerance\n";
+}
+
+/*
+ * One layer of in->out for a batch, every candidate and every activation
+ */
+static void check_layer( vector<candidate> &list,int in,int out,int batch ) {
+  const VectorBatch x( batch,in,true ), d( batch,out,true );
+  const Matrix w( out,in,1,true );
+  const Vector b( out,1 );
+  // the values the derivative is taken of: activated, or the input for grad_of_input
+  const VectorBatch z( batch,in,true );
+
+  for ( acFunc f : { RELU,SIG,SMAX,NONE,TANH,GELU,SILU,ELU } ) {
+    for ( int approximation : {0,2,3,4} ) {
+      VectorBatch unfused( batch,out );
+      x.v2mp( w,unfused );
+      unfused.addh( b );
+      // for the softmax the fused product only adds the bias
+      if (f!=SMAX)
+	apply_activation_io( f,unfused,unfused,approximation );
+      for ( auto &c : list ) {
+	VectorBatch y( batch,out );
+	c.forward( x,w,b,f,approximation,y );
+	record( c,error_ratio( y,unfused ),"forward",f,in,out,batch );
+      }
+    }
+
+    const acFunc elementwise = ( f==SMAX ? NONE : f );
+    VectorBatch a( z ), product( batch,in ), grad( batch,in ), unfused_grad( batch,in );
+    if (not grad_of_input(f))
+      apply_activation_io( elementwise,z,a );
+    d.v2mtp( w,product );
+    activate_gradient_io( elementwise,a,grad );
+    unfused_grad.hadamard( product,grad );
+    for ( auto &c : list ) {
+      VectorBatch y( batch,in );
+      c.backward( d,w,a,f,y );
+      record( c,error_ratio( y,unfused_grad ),"backward",f,in,out,batch );
+    }
+  }
+}
+
+int main() {
+
+  srand(17);
+  auto list = candidates();
+  cout << "blas: " << blas_backend() << "\n";
+
+  // the panel width is 16384/m, with m the output size forward, the input size backward
+  for ( auto s : vector< vector<int> >{ {13,37,29},{200,300,150},{300,7,2500} } )
+    check_layer( list,s[0],s[1],s[2] );
+
+  bool ok{true};
+  for ( auto &c : list ) {
+    cout << c.name << ": " << c.products << " products, largest error "
+	 << c.worst << " of the tolerance"
+	 << ( c.failures>0 ? "  <== FAILED" : "" ) << "\n";
+    ok = ok and c.failures==0;
+  }
+  if (not ok) {
+    cout << "Some fused products are off\n";
+    return 1;
+  }
+  cout << "Fused products agree with the unfused ones\n";
+  return 0;
+}
@@ -0,0 +1,211 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "blas.h"
+#include "gemm.h"
+#include "gemm_blocked.h"
+#include "simd.h"
+#include "test_simd.h"
+
+using namespace std;
+
+/*
+ * Every gemm against a triple loop in double precision.
+ *
+ * The products are C <- alpha op(A) op(B) + beta C, column major,
+ * with every leading dimension padded beyond the matrix;
+ * m, n, k go just below, on, and just above the MR, NR of the micro kernels
+ * and the MC, KC, NC blocking of gemm_blocked.h.
+ * With beta zero C starts out as NaN, which must not be read;
+ * the padding of C must not be written.
+ *
+ * An element passes if it is within (k+2) eps ( |alpha| sum_p |a_ip b_pj| + |beta c_ij| )
+ * of the triple loop: the bound on the rounding of any summation order.
+ *
+ * The simd kernels are checked at the level of the processor and every lower one.
+ */
+
+using gemm_function = function< void
+  ( bool,bool,int,int,int, float,const float*,int,const float*,int, float,float*,int ) >;
+
+/*
+ * A gemm with the strides of gemm.h, in the column-major interface of blas.h;
+ * see blas_impl_reference.cpp
+ */
+template< typename Strided >
+gemm_function column_major( Strided gemm ) {
+  return [gemm] ( bool transa,bool transb,int m,int n,int k,
+		  float alpha,const float *a,int lda,const float *b,int ldb,
+		  float beta,float *c,int ldc ) {
+    gemm( m,n,k, alpha,
+	  a, ( transa ? lda : 1 ),( transa ? 1 : lda ),
+	  b, ( transb ? ldb : 1 ),( transb ? 1 : ldb ),
+	  beta, c, 1,ldc );
+  };
+}
+
+// gemm_blocked with a micro tile of another shape than the library ones
+static constexpr int MRtest = 4, NRtest = 3;
+static void micro_kernel_test( int kc,const float *ap,const float *bp,float *ab ) {
+  for (int i=0; i<MRtest*NRtest; i++) ab[i] = 0.f;
+  for (int p=0; p<kc; p++)
+    for (int j=0; j<NRtest; j++)
+      for (int i=0; i<MRtest; i++)
+	ab[ i+j*MRtest ] += ap[ p*MRtest+i ] * bp[ p*NRtest+j ];
+}
+
+struct candidate {
+  string name; gemm_function gemm;
+  int products{0},failures{0}; double worst{0.};
+};
+
+static vector<candidate> candidates() {
+  vector<candidate> list;
+  list.push_back( { "gemm_reference",column_major( gemm_reference ) } );
+  list.push_back( { "gemm_blocked<4,3>",column_major
+      ( [] ( int m,int n,int k, float alpha,
+	     const float *a,int rsa,int csa, const float *b,int rsb,int csb,
+	     float beta, float *c,int rsc,int csc ) {
+	gemm_blocked<MRtest,NRtest,micro_kernel_test>
+	  ( m,n,k, alpha, a,rsa,csa, b,rsb,csb, beta, c,rsc,csc );
+      } ) } );
+  list.push_back( { string("gemm_simd ")+simd_name(simd_level()),column_major( gemm_simd ) } );
+  vector<const blas_kernels*> backends{ &blas_reference_kernels,&blas_simd_kernels };
+#ifdef BLISNN
+  backends.push_back( &blas_blis_kernels );
+#endif
+#ifdef USE_CBLAS
+  backends.push_back( &blas_cblas_kernels );
+#endif
+  for ( auto b : backends )
+    list.push_back( { string("blas ")+b->name,b->gemm } );
+  list.push_back( { "blas_sgemm",blas_sgemm } );
+  return list;
+}
+
+// op(X), rows x cols, stored column major with padding: ld is larger than needed
+struct operand {
+  int rows,cols,ld; bool trans;
+  vector<float> v;
+  operand( int rows,int cols,bool trans )
+    : rows(rows),cols(cols),ld( ( trans ? cols : rows )+3 ),trans(trans),
+      v( ld*( trans ? rows : cols ) ) {
+    for ( auto &e : v )
+      e = 2.f*rand()/static_cast<float>(RAND_MAX) - 1.f;
+  };
+  float at( int i,int j ) const { return trans ? v[ j+i*ld ] : v[ i+j*ld ]; };
+};
+
+/*
+ * Run one product with every candidate; false if any of them fails
+ */
+static bool check_product
+    ( vector<candidate> &list,int m,int n,int k,bool transa,bool transb,float beta ) {
+  const float alpha = .75f;
+  const operand a( m,k,transa ), b( k,n,transb );
+  const int ldc = m+2;
+  const float pad = 1234.5f;
+  vector<float> c0( ldc*n,pad );
+  for (int j=0; j<n; j++)
+    for (int i=0; i<m; i++)
+      c0[ i+j*ldc ] = ( beta==0.f ? NAN : 2.f*rand()/static_cast<float>(RAND_MAX) - 1.f );
+
+  vector<double> exact( m*n ), bound( m*n );
+  for (int j=0; j<n; j++)
+    for (int i=0; i<m; i++) {
+      double s{0.}, sabs{0.};
+      for (int p=0; p<k; p++) {
+	const double t = static_cast<double>( a.at(i,p) )*b.at(p,j);
+	s += t; sabs += fabs(t);
+      }
+      const double cij = ( beta==0.f ? 0. : c0[ i+j*ldc ] );
+      exact[ i+j*m ] = alpha*s + beta*cij;
+      bound[ i+j*m ] = (k+2)*FLT_EPSILON*( fabs(alpha)*sabs + fabs(beta*cij) ) + FLT_MIN;
+    }
+
+  bool ok{true};
+  for ( auto &cand : list ) {
+    vector<float> c(c0);
+    cand.gemm( transa,transb,m,n,k, alpha, a.v.data(),a.ld, b.v.data(),b.ld,
+	       beta, c.data(),ldc );
+    double worst{0.}; bool padded{true};
+    for (int j=0; j<n; j++) {
+      for (int i=0; i<m; i++) {
+	const double e = fabs( c[ i+j*ldc ] - exact[ i+j*m ] )/bound[ i+j*m ];
+	worst = ( e>worst or std::isnan(e) ? e : worst );
+      }
+      for (int i=m; i<ldc; i++)
+	padded = padded and c[ i+j*ldc ]==pad;
+    }
+    cand.products++;
+    cand.worst = std::max( cand.worst,worst );
+    if (not ( worst<=1. ) or not padded) {
+      if (cand.failures++<5)
+	cout << cand.name << " fails on " << m << "x" << n << "x" << k
+	     << ( transa ? " A^t" : "" ) << ( transb ? " B^t" : "" ) << ", beta " << beta
+	     << ": error " << worst << " of the tolerance"
+	     << ( padded ? "" : ", writes the padding of C" ) << "\n";
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+int main( int,char **argv ) {
+
+  srand(17);
+  auto list = candidates();
+  cout << "blas: " << blas_backend() << "\n";
+
+  // around the micro tiles: MR 4,8,16,32 and NR 3,6,12; around MC and KC
+  const vector<int>
+    ms{1,3,4,5,7,8,9,15,16,17,31,32,33,127,128,129},
+    ns{1,2,3,5,6,7,11,12,13,25},
+    ks{1,2,7,255,256,257};
+  vector< vector<int> > shapes;
+  for ( int m : ms ) for ( int n : ns ) for ( int k : ks )
+    shapes.push_back( {m,n,k} );
+  // more than one block of every kind, and past NC
+  for ( auto s : vector< vector<int> >{ {300,40,600},{257,129,513},{3,3073,3},{0,5,5},{5,0,5},{5,5,0} } )
+    shapes.push_back( s );
+
+  bool ok{true};
+  for ( auto s : shapes )
+    for ( bool transa : {false,true} )
+      for ( bool transb : {false,true} )
+	for ( float beta : {0.f,1.f} )
+	  ok = check_product( list,s[0],s[1],s[2],transa,transb,beta ) and ok;
+
+  for ( auto &cand : list )
+    cout << cand.name << ": " << cand.products << " products, largest error "
+	 << cand.worst << " of the tolerance"
+	 << ( cand.failures>0 ? "  <== FAILED" : "" ) << "\n";
+
+  ok = rerun_lower_simd_levels( argv[0] ) and ok;
+
+  if (not ok) {
+    cout << "Some products are off\n";
+    return 1;
+  }
+  cout << "All products agree with the triple loop\n";
+  return 0;
+}
@@ -0,0 +1,336 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "vector2.h"
+#include "funcs.h"
+#include "net.h"
+#include "dataset.h"
+#include "vmath.h"
+#include "test_simd.h"
+
+using namespace std;
+
+/*
+ * Derivatives against central differences in double precision.
+ *
+ * smaxGrad_io( s,v,jv ) is jv = J v, with J the Jacobian of the softmax at s:
+ * against ( softmax(x+hv) - softmax(x-hv) )/2h, with h = 1e-4.
+ * An element passes if it is within (n+16) eps s_j ( |v_j| + sum_i s_i |v_i| ),
+ * the rounding of the sum over the n elements of a sample
+ * plus some ulps for the softmax output s itself;
+ * the truncation of the difference is some 1e-8 of that.
+ *
+ * The activations tanh, GELU (tanh form), SiLU and ELU:
+ * - the exact derivatives in closed form, against the difference
+ *   ( f(x+h)-f(x-h) )/2h of the exact function, h = 1e-6, within 1e-8 (1+|f'|),
+ *   and h/2 near zero, where the second derivative of ELU jumps;
+ * - the polynomial functions of vmath.h, one by one and through apply_activation_io,
+ *   against the exact function, within 8 eps |f| + eps
+ *   (the ELU e^x-1 is off by an ulp of 1 near zero);
+ * - the derivatives the layers use, one by one and through activate_gradient_io,
+ *   against the same difference, within 32 eps (1+|f'|);
+ *   those of tanh and ELU take the output of the polynomial function.
+ * The points are every 1/128 on [-10,10], and around zero and the tanh branches.
+ *
+ * Backpropagation, with a softmax or sigmoid output layer and either loss:
+ * the weight and bias gradients of every layer,
+ * dw and db, against ( L(p+h) - L(p-h) )/2h for every parameter p,
+ * with L the loss summed over the batch, times the batch size,
+ * as the output delta is scaled by it, see Layer::set_topdelta; h = 1e-2.
+ * The loss is in float, so a layer passes if the difference is within
+ * 1e-2 of the norm of the gradient, for all of its parameters together.
+ * The same with feature-major hidden layers, see batch_layout,
+ * whose outputs are also those of the sample-major net, within 1e-5.
+ * The array kernels run at every simd level up to that of the processor.
+ */
+
+struct check {
+  string name;
+  int values{0},failures{0}; double worst{0.};
+  void record( double error,const string &where ) {
+    values++;
+    worst = ( error>worst or std::isnan(error) ? error : worst );
+    if (not ( error<=1. ) and failures++<5)
+      cout << name << " fails " << where << ": error " << error << " of the tolerance\n";
+  };
+};
+
+// softmax of n elements in double, two sweeps
+static vector<double> softmax( int n,const double *x ) {
+  const double xmax = *std::max_element( x,x+n );
+  vector<double> y(n); double sum{0.};
+  for (int i=0; i<n; i++)
+    sum += y[i] = exp( x[i]-xmax );
+  for ( auto &e : y )
+    e /= sum;
+  return y;
+}
+
+/*
+ * J v for a batch of samples of n elements,
+ * with the softmax outputs as softmax_io makes them
+ */
+static void check_smax_grad( check &c,int n,int batch ) {
+  VectorBatch x( batch,n,true ), v( batch,n,true ), s, jv;
+  // the random values are in [0,1); spread them so that the outputs differ
+  for (int i=0; i<x.size(); i++)
+    x.data()[i] = 6.f*x.data()[i] - 3.f;
+  softmax_io( x,s );
+  smaxGrad_io( s,v,jv );
+
+  const double h = 1.e-4;
+  for (int j=0; j<batch; j++) {
+    const float *xj = x.data()+x.index(0,j), *vj = v.data()+v.index(0,j),
+      *sj = s.data()+s.index(0,j), *jvj = jv.data()+jv.index(0,j);
+    vector<double> xplus(n), xminus(n);
+    double svabs{0.};
+    for (int i=0; i<n; i++) {
+      xplus[i]  = xj[i] + h*vj[i];
+      xminus[i] = xj[i] - h*vj[i];
+      svabs += sj[i]*fabs(vj[i]);
+    }
+    const auto splus = softmax( n,xplus.data() ), sminus = softmax( n,xminus.data() );
+    double worst{0.};
+    for (int i=0; i<n; i++) {
+      const double difference = ( splus[i]-sminus[i] )/( 2*h );
+      const double bound = (n+16)*FLT_EPSILON*sj[i]*( fabs(vj[i]) + svabs ) + FLT_MIN;
+      const double e = fabs( jvj[i]-difference )/bound;
+      worst = ( e>worst or std::isnan(e) ? e : worst );
+    }
+    c.record( worst,"on "+to_string(n)+" elements, sample "+to_string(j) );
+  }
+}
+
+/*
+ * An activation: exact in double, and as the layers compute it in float;
+ * the float derivative gets the input x and the output a, and takes the one it needs
+ */
+struct activation_forms {
+  acFunc f;
+  double (*exact)( double ); double (*exact_grad)( double );
+  float (*poly)( float ); float (*grad)( float x,float a );
+};
+
+static double sigma( double z ) { return 1./( 1.+exp(-z) ); }
+// 2 sqrt(2/pi) and .044715 times that
+static const double gelu_a = 2.*sqrt( 2./M_PI ), gelu_b = .044715*gelu_a;
+
+static const vector<activation_forms> activations{
+  { TANH,
+    [] ( double x ) { return tanh(x); },
+    [] ( double x ) { return 1.-tanh(x)*tanh(x); },
+    tanh_poly,
+    [] ( float,float a ) { return tanhGrad_scalar(a); } },
+  { GELU,
+    [] ( double x ) { return x*sigma( x*( gelu_a+gelu_b*x*x ) ); },
+    [] ( double x ) {
+      const double s = sigma( x*( gelu_a+gelu_b*x*x ) );
+      return s + x*s*( 1.-s )*( gelu_a+3.*gelu_b*x*x ); },
+    gelu_poly,
+    [] ( float x,float ) { return gelu_grad_poly(x); } },
+  { SILU,
+    [] ( double x ) { return x*sigma(x); },
+    [] ( double x ) { return sigma(x) + x*sigma(x)*( 1.-sigma(x) ); },
+    silu_poly,
+    [] ( float x,float ) { return silu_grad_poly(x); } },
+  { ELU,
+    [] ( double x ) { return ( x>0 ? x : expm1(x) ); },
+    [] ( double x ) { return ( x>0 ? 1. : exp(x) ); },
+    elu_poly,
+    [] ( float,float a ) { return elu_grad_poly(a); } },
+};
+
+static const char *name( acFunc f ) {
+  switch (f) {
+  case TANH : return "tanh";
+  case GELU : return "gelu";
+  case SILU : return "silu";
+  default   : return "elu";
+  }
+}
+
+/*
+ * One activation on all points:
+ * the exact derivative, then the polynomial forms one by one and as arrays
+ */
+static void check_activation
+    ( const activation_forms &act,const vector<float> &points,
+      check &exact,check &values,check &grads ) {
+  const int n = points.size();
+  VectorBatch x( 1,n ), a, g;
+  std::copy( points.begin(),points.end(),x.data() );
+  apply_activation_io( act.f,x,a );
+  activate_gradient_io( act.f,( grad_of_input(act.f) ? x : a ),g );
+
+  const double h = 1.e-6;
+  double worst_exact{0.}, worst_value{0.}, worst_grad{0.};
+  auto worst = [] ( double &w,double e ) { w = ( e>w or std::isnan(e) ? e : w ); };
+  for (int i=0; i<n; i++) {
+    const float xi = points[i];
+    const double f = act.exact(xi), fprime = act.exact_grad(xi),
+      difference = ( act.exact(xi+h)-act.exact(xi-h) )/( 2*h );
+    const double exact_bound = 1.e-8*( 1.+fabs(difference) ) + ( fabs(xi)<h ? h/2 : 0. );
+    worst( worst_exact, fabs( fprime-difference )/exact_bound );
+
+    const double value_bound = 8*FLT_EPSILON*fabs(f) + FLT_EPSILON;
+    const float ai = act.poly(xi);
+    worst( worst_value, fabs( ai-f )/value_bound );
+    worst( worst_value, fabs( a.data()[i]-f )/value_bound );
+
+    const double grad_bound = 32*FLT_EPSILON*( 1.+fabs(difference) );
+    worst( worst_grad, fabs( act.grad(xi,ai)-difference )/grad_bound );
+    worst( worst_grad, fabs( g.data()[i]-difference )/grad_bound );
+  }
+  exact.record ( worst_exact,string("for ")+name(act.f) );
+  values.record( worst_value,string("for ")+name(act.f) );
+  grads.record ( worst_grad, string("for ")+name(act.f) );
+}
+
+/*
+ * The loss the gradients are of, as a function of one parameter:
+ * calculateLoss is per sample, so this is that times the batch size squared
+ */
+static double scaled_loss( Net &net,const Dataset &data,float &p,float value ) {
+  const float keep = p;
+  p = value;
+  const double bs = data.size(), loss = static_cast<double>( net.calculateLoss(data) )*bs*bs;
+  p = keep;
+  return loss;
+}
+
+//! the norm of g minus the differences, in units of 1e-2 the norm of g
+template< typename Parameters >
+static double gradient_error
+    ( Net &net,const Dataset &data,Parameters &p,const float *g,int n ) {
+  const double h = 1.e-2;
+  double diff{0.}, norm{0.};
+  for (int i=0; i<n; i++) {
+    float &pi = p.values().data()[i];
+    const double difference =
+      ( scaled_loss( net,data,pi,pi+h )-scaled_loss( net,data,pi,pi-h ) )/( 2*h );
+    diff += ( g[i]-difference )*( g[i]-difference );
+    norm += g[i]*g[i];
+  }
+  return sqrt(diff)/( 1.e-2*sqrt(norm) + FLT_EPSILON );
+}
+
+/*
+ * A net of two hidden layers on a batch of random inputs and one-hot labels,
+ * in the layouts first and second; the first has the activation hidden
+ */
+static void check_backprop
+    ( check &c,acFunc last,lossfn loss,const string &what,
+      batch_layout first=sample_major,batch_layout second=sample_major,acFunc hidden=TANH ) {
+  const int insize = 5, classes = 3, batch = 7;
+  Dataset data(classes);
+  for (int item=0; item<batch; item++) {
+    vector<float> in(insize), out(classes,0.f);
+    for ( auto &e : in )
+      e = 2.f*rand()/static_cast<float>(RAND_MAX) - 1.f;
+    out.at( item%classes ) = 1.f;
+    data.push_back( dataItem{in,out} );
+  }
+  Net net(data);
+  net.addLayer(6,hidden,first);
+  net.addLayer(4,SIG,second);
+  net.addLayer(classes,last);
+  net.set_lossfunction(loss);
+
+  if (first==feature_major or second==feature_major) {
+    // the same net, all sample major
+    Net reference(data);
+    reference.addLayer(6,hidden);
+    reference.addLayer(4,SIG);
+    reference.addLayer(classes,last);
+    for (int l=0; l<3; l++) {
+      reference.at(l).weight_values() = net.at(l).weight_values();
+      reference.at(l).bias_values() = net.at(l).bias_values();
+    }
+    net.feedForward( data.inputs() );
+    reference.feedForward( data.inputs() );
+    const VectorBatch &out = net.outputs(), &ref = reference.outputs();
+    double worst{0.};
+    for (int i=0; i<out.size(); i++)
+      worst = std::max( worst,fabs( out.data()[i]-ref.data()[i] )/1.e-5 );
+    c.record( worst,"for the outputs, "+what );
+  }
+
+  net.feedForward( data.inputs() );
+  net.backPropagate( data.inputs(),data.labels() );
+  for (int l=0; l<3; l++) {
+    auto &layer = net.at(l);
+    const Matrix dw = layer.weight_gradient();
+    const Vector db = layer.bias_gradient();
+    const string where = what+", layer "+to_string(l);
+    c.record( gradient_error( net,data,layer.weight_values(),
+			      dw.values().data(),dw.values().size() ),"for dw, "+where );
+    c.record( gradient_error( net,data,layer.bias_values(),db.data(),db.size() ),
+	      "for db, "+where );
+  }
+}
+
+int main( int,char **argv ) {
+
+  srand(17);
+
+  check smax{"smaxGrad_io"};
+  for ( int n : {1,2,3,10,37,100,1000} )
+    check_smax_grad( smax,n,5 );
+
+  vector<float> points;
+  for (int i=-1280; i<=1280; i++)
+    points.push_back( i/128.f );
+  for ( float x : { 1.e-3f,1.e-6f,vmath::tanh_small,vmath::tanh_big } )
+    for ( float y : { x,nextafterf(x,0.f),nextafterf(x,20.f) } ) {
+      points.push_back(y); points.push_back(-y);
+    }
+  check exact{"exact derivatives"},
+    values{"polynomial activations"}, grads{"polynomial derivatives"};
+  for ( const auto &act : activations )
+    check_activation( act,points,exact,values,grads );
+
+  check backprop{"backpropagation"};
+  check_backprop( backprop,SMAX,cce,"softmax, cross entropy" );
+  check_backprop( backprop,SMAX,mse,"softmax, squared error" );
+  check_backprop( backprop,SIG,cce,"sigmoid, cross entropy" );
+  check_backprop( backprop,SIG,mse,"sigmoid, squared error" );
+  check_backprop( backprop,SMAX,cce,"feature-major hidden layers",
+		  feature_major,feature_major );
+  check_backprop( backprop,SIG,mse,"feature-major gelu layer",
+		  feature_major,sample_major,GELU );
+
+  bool ok{true};
+  for ( auto c : { &smax,&exact,&values,&grads,&backprop } ) {
+    cout << c->name << ": " << c->values << " checks, largest error "
+	 << c->worst << " of the tolerance"
+	 << ( c->failures>0 ? "  <== FAILED" : "" ) << "\n";
+    ok = ok and c->failures==0;
+  }
+
+  ok = rerun_lower_simd_levels( argv[0] ) and ok;
+
+  if (not ok) {
+    cout << "Some derivatives are off\n";
+    return 1;
+  }
+  cout << "All derivatives agree with the differences\n";
+  return 0;
+}
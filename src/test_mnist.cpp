@@ -33,6 +33,7 @@ using std::vector;
 #include "dataset.h"
 #include "vector.h"
 #include "trace.h"
+#include "blas.h"
 
 using namespace std;
 static int trace_level;
@@ -55,6 +56,7 @@ int main(int argc,char **argv){
       ("r,learningrate", "Learning rate for the optimizer", cxxopts::value<float>()->default_value("0.001"))
       ("b,batchsize", "Batch size for the training data", cxxopts::value<int>()->default_value("256"))
       ("t,tracing","Level of tracing: 0=default 1=scalars 2=arrays",cxxopts::value<int>()->default_value("0"))
+      ("a,approximate","Check approximate activations with this error bound on the test set",cxxopts::value<float>())
 	  ;
 		
     auto result = options.parse(argc,argv);
@@ -76,6 +78,8 @@ int main(int argc,char **argv){
     }
 	
     set_trace_level( result["t"].as<int>() );
+    if (trace_progress())
+      cout << "Linear algebra backend: " << blas_backend() << endl;
     int network_optimizer = result["o"].as<int>();
     int epochs = epochs = result["e"].as<int>();
     float lr = result["r"].as<float>();
@@ -140,11 +144,17 @@ int main(int argc,char **argv){
       seconds = microsec_duration/1000000,
       micros  = microsec_duration - 1000000*seconds;
     while (micros>=1000) micros /= 10;
-    auto acc = test_net.accuracy(test_data);
-    cout << "Final Accuracy over test data: " << acc << "\n"
-	 << "    attained in " << seconds << "." << micros << " sec" << "\n";
+    const auto eval = test_net.evaluate(test_data);
+    cout << "Final Accuracy over test data: " << eval.accuracy << "\n"
+	 << "    attained in " << seconds << "." << micros << " sec" << "\n"
+	 << "Test data: " << eval;
 	
     test_net.saveModel("weights.bin");
+    if (result.count("approximate")) {
+      test_net.freeze();
+      test_net.set_approximation( result["approximate"].as<float>() );
+      cout << "Approximate activations, " << test_net.check_approximation(test_data) << "\n";
+    }
     test_net.info();
 
   } catch ( string e ) {
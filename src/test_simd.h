@@ -0,0 +1,42 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_TEST_SIMD_H
+#define SRC_TEST_SIMD_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "simd.h"
+
+/*
+ * For the test programs.
+ * The instruction set of the simd kernels is fixed at the first call,
+ * so a program sees only one; this runs it again, as a process of its own,
+ * for every EDUDL_SIMD level below that of the processor.
+ * Not from one of those runs itself.
+ * Returns false if any of the runs fails.
+ */
+inline bool rerun_lower_simd_levels( const char *program ) {
+  bool ok{true};
+  if (std::getenv("EDUDL_SIMD")==nullptr)
+    for ( auto isa : { simd_isa::generic,simd_isa::sse,simd_isa::avx2 } )
+      if (isa<simd_level()) {
+	std::cout << "\nEDUDL_SIMD=" << simd_name(isa) << "\n" << std::flush;
+	const std::string run = std::string("EDUDL_SIMD=")+simd_name(isa)+" "+program;
+	ok = std::system( run.c_str() )==0 and ok;
+      }
+  return ok;
+}
+
+#endif //SRC_TEST_SIMD_H
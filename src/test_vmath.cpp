@@ -0,0 +1,159 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include <iostream>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "vmath.h"
+#ifdef USE_SIMD
+#include "simd.h"
+#endif
+#include "test_simd.h"
+
+using namespace std;
+
+/*
+ * vsoftmax against the two-pass softmax in double:
+ * the maximum in one sweep, then the exponentials and their sum.
+ * With AVX2 and AVX-512 vsoftmax finds the maximum and the sum in one sweep,
+ * rescaling the sum when the maximum grows; elsewhere it is two-pass itself.
+ *
+ * The inputs go up to 1e4 in magnitude, where an exponential
+ * without the maximum subtracted overflows; there are ramps up, so that
+ * the maximum grows in every block, and down, ties, and a single spike.
+ * The lengths are around the 8 and 16 lanes and the blocks of four registers.
+ * Every input is done with and without the log, out of place and in place,
+ * with the accurate exponential and every approximate one.
+ *
+ * An output y passes if it is within ( (n+8) eps + 4 eps |log y| + 2 e_d ) y + 2 FLT_MIN,
+ * and the log within (n+8) eps + 4 eps |log y| + 2 e_d, with
+ * - (n+8) eps for the sum of n exponentials and some ulps for each of them;
+ * - 4 eps |log y| for the rounding of x - max, which the exponential magnifies;
+ * - e_d the error exp_approximation_error of the degree, 0 for the accurate one;
+ * - FLT_MIN since the exponential does not go below that.
+ *
+ * The program checks the kernels of the processor, then runs again
+ * at every lower EDUDL_SIMD level.
+ */
+
+struct check {
+  string name;
+  int values{0},failures{0}; double worst{0.};
+  void record( double error,const string &where ) {
+    values++;
+    worst = ( error>worst or std::isnan(error) ? error : worst );
+    if (not ( error<=1. ) and failures++<5)
+      cout << name << " fails " << where << ": error " << error << " of the tolerance\n";
+  };
+};
+
+static float uniform() { return 2.f*rand()/static_cast<float>(RAND_MAX) - 1.f; }
+
+// the inputs of one length, by name
+static vector< pair<string,vector<float>> > inputs( int n ) {
+  vector< pair<string,vector<float>> > list;
+  for ( float scale : {1.f,10.f,100.f,1.e4f} ) {
+    vector<float> x(n);
+    for ( auto &e : x ) e = scale*uniform();
+    list.push_back( { "random times "+to_string(scale),x } );
+  }
+  for ( float shift : {1.e4f,-1.e4f} ) {
+    vector<float> x(n);
+    for ( auto &e : x ) e = shift+uniform();
+    list.push_back( { "random plus "+to_string(shift),x } );
+  }
+  vector<float> up(n), down(n), tie(n,3.f), spike(n,0.f);
+  for (int i=0; i<n; i++) {
+    up[i] = .25f*i; down[i] = -up[i];
+  }
+  spike[n/2] = 1.e4f;
+  list.push_back( { "ramp up",up } );
+  list.push_back( { "ramp down",down } );
+  list.push_back( { "ties",tie } );
+  list.push_back( { "spike",spike } );
+  return list;
+}
+
+/*
+ * One input, every way of calling vsoftmax
+ */
+static void check_softmax
+    ( check &outputs,check &logs,const string &what,const vector<float> &x ) {
+  const int n = x.size();
+  const double xmax = *std::max_element( x.begin(),x.end() );
+  double sum{0.};
+  for ( auto e : x ) sum += exp( e-xmax );
+  vector<double> s(n), logs_exact(n);
+  for (int i=0; i<n; i++) {
+    logs_exact[i] = ( x[i]-xmax ) - log(sum);
+    s[i] = exp( logs_exact[i] );
+  }
+
+  for ( int approximation : {0,2,3,4} )
+    for ( bool with_log : {false,true} )
+      for ( bool in_place : {false,true} ) {
+	vector<float> y(x), logy(n);
+	vsoftmax( n, ( in_place ? y.data() : x.data() ),y.data(), 0.f,1.f,
+		  ( with_log ? logy.data() : nullptr ),approximation );
+	const double ed = ( approximation==0 ? 0. : exp_approximation_error(approximation) );
+	double worst_y{0.}, worst_log{0.};
+	for (int i=0; i<n; i++) {
+	  const double relative = (n+8)*FLT_EPSILON + 4*FLT_EPSILON*fabs(logs_exact[i]) + 2*ed,
+	    ey = fabs( y[i]-s[i] )/( relative*s[i] + 2*FLT_MIN ),
+	    elog = fabs( logy[i]-logs_exact[i] )/relative;
+	  worst_y = ( ey>worst_y or std::isnan(ey) ? ey : worst_y );
+	  if (with_log)
+	    worst_log = ( elog>worst_log or std::isnan(elog) ? elog : worst_log );
+	}
+	const string where = "on "+what+", "+to_string(n)+" elements, degree "
+	  +to_string(approximation)+( with_log ? ", with log" : "" )+( in_place ? ", in place" : "" );
+	outputs.record( worst_y,where );
+	if (with_log)
+	  logs.record( worst_log,where );
+      }
+}
+
+int main( int,char **argv ) {
+
+  srand(17);
+#ifdef USE_SIMD
+  cout << "simd: " << simd_name(simd_level()) << "\n";
+#endif
+
+  check outputs{"vsoftmax"}, logs{"vsoftmax log"};
+  for ( int n : {1,2,3,7,8,9,15,16,17,31,32,33,63,64,65,100,1000,1001} )
+    for ( const auto &input : inputs(n) )
+      check_softmax( outputs,logs,input.first,input.second );
+
+  bool ok{true};
+  for ( auto c : { &outputs,&logs } ) {
+    cout << c->name << ": " << c->values << " checks, largest error "
+	 << c->worst << " of the tolerance"
+	 << ( c->failures>0 ? "  <== FAILED" : "" ) << "\n";
+    ok = ok and c->failures==0;
+  }
+
+  ok = rerun_lower_simd_levels( argv[0] ) and ok;
+
+  if (not ok) {
+    cout << "Some softmax outputs are off\n";
+    return 1;
+  }
+  cout << "The softmax agrees with the two-pass one\n";
+  return 0;
+}
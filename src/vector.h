@@ -17,48 +17,62 @@
 #include <vector>
 #include <cassert>
 #include <cmath>
+#include "expr.h"
+#include "aligned.h"
 
-class VectorBatch; // forward for friending
+template< typename Layout > class BasicVectorBatch; // forward for friending
 class Matrix; // forward for friending
 class Vector {
-  friend class VectorBatch;
+  template< typename Layout > friend class BasicVectorBatch;
   friend class Matrix;
 private:
-    std::vector<float> vals;
+    aligned_vector vals;
 public:
     Vector();
-    Vector( std::vector<float> vals );
+    Vector( const std::vector<float> &vals );
 	Vector(int size, int init);
+    // evaluate an elementwise expression, see expr.h
+    template< typename E >
+    Vector( const expr<E> &e ) { *this = e; };
     int size() const;
 	int r;
 	int c=1;
 	void show();
     void add( const Vector &v1);
 	void set_ax( float a, Vector &x );
-    std::vector<float>& values() { return vals; };
-    const std::vector<float>& values() const { return vals; };
+    aligned_vector& values() { return vals; };
+    const aligned_vector& values() const { return vals; };
     float *data() { return vals.data(); };
     const float *data() const { return vals.data(); };
     void zeros();
     void square();
-    Vector operator-(); // Unary negate operator
-    Vector& operator=(const Vector& m2); // Copy constructor
-    Vector operator+(const Vector &m2); // Element-wise addition
-    Vector operator*(const Vector &m2); // Hadamard Product Element-wise multiplication
-    Vector operator/(const Vector &m2); // Element-wise division
-    Vector operator-(const Vector &m2); // Element-wise subtraction
-    friend Vector operator-(const float &c, const Vector &m); // for constant
-    friend Vector operator*(const float &c, const Vector &m); // for constant-matrix multiplication
-    friend Vector operator/(const Vector &m, const float &c); // for matrix-constant division
+    // plain copies and moves of the values
+    Vector( const Vector& ) = default;
+    Vector( Vector&& ) = default;
+    Vector& operator=( const Vector& ) = default;
+    Vector& operator=( Vector&& ) = default;
+    // Element-wise +,-,*,/, and with a scalar, are expressions: see expr.h
+    template< typename E >
+    Vector& operator=( const expr<E> &e ) {
+      const int n = e.self().size();
+      vals.resize(n); r = n;
+      expr_evaluate( e,vals.data() );
+      return *this;
+    };
 
 };
 
+template<>
+struct expr_container<Vector> : std::true_type {
+  static int size( const Vector &v ) { return v.size(); };
+};
+
 class Categorization {
 private:
   std::vector<float> _probabilities;
 public:
   Categorization( Vector v )
-    : _probabilities(v.values()) {};
+    : _probabilities( v.values().begin(),v.values().end() ) {};
   Categorization( std::vector<float> p)
     : _probabilities(p) {};
   Categorization(int n)
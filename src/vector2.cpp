@@ -12,6 +12,9 @@
  ****************************************************************/
 
 #include "vector2.h"
+#include "blas.h"
+#include "parallel.h"
+#include "trace.h"
 #include <iostream>
 using std::cout;
 using std::endl;
@@ -26,17 +29,20 @@ using std::vector;
 
 /*
  * These are the vector batch routines that do not have a optimized implementation,
- * such as using BLIS.
+ * such as using BLIS; they are instantiated for both layouts at the end.
  */
 
-VectorBatch::VectorBatch() { // Default constructor
+template< typename Layout >
+BasicVectorBatch<Layout>::BasicVectorBatch() { // Default constructor
 }
 
-VectorBatch::VectorBatch( int i ) {
+template< typename Layout >
+BasicVectorBatch<Layout>::BasicVectorBatch( int i ) {
   allocate(0,i);
 }
 
-void VectorBatch::allocate(int batchsize,int itemsize) {
+template< typename Layout >
+void BasicVectorBatch<Layout>::allocate(int batchsize,int itemsize) {
   // we allow a batchsize of zero
   assert(batchsize>=0);
   assert(itemsize>0);
@@ -45,28 +51,43 @@ void VectorBatch::allocate(int batchsize,int itemsize) {
   set_item_size(itemsize);
 };
 
-void VectorBatch::display( string header) const {
+template< typename Layout >
+void BasicVectorBatch<Layout>::display( string header) const {
   cout << header << "\n";
   for (int j=0; j<batch_size(); j++) {
     for (int i=0; i<item_size(); i++)
       cout << setprecision(5)
-	   << vals_vector().at( INDEXc(i,j,item_size(),batch_size()) )
+	   << vals_vector().at( index(i,j) )
 	   << " ";
     cout << "\n";
   }
 };
 
-void VectorBatch::set_col(int j,const std::vector<float> &v ) {
+/*
+ * The parent is const, so the view is read-only,
+ * see batch_storage: writing to it first makes a copy.
+ */
+VectorBatchView::VectorBatchView( const VectorBatch &parent,int first,int n ) {
+  const int m = parent.item_size();
+  assert( first>=0 and n>=0 and first+n<=parent.batch_size() );
+  view_storage( parent.data(first*m),n*m );
+  allocate( n,m );
+};
+
+template< typename Layout >
+void BasicVectorBatch<Layout>::set_col(int j,const std::vector<float> &v ) {
   assert( j<batch_size() );
   assert( v.size()==item_size() );
-  for (int i = 0; i<nvectors; i++) {
-    vals.at( j + vector_size * i ) = v.at(i);
+  for (int i = 0; i<item_size(); i++) {
+    vals.at( index(i,j) ) = v.at(i);
   };
 };
 
-void VectorBatch::add_vector( const std::vector<float> &v ) {
+template< typename Layout >
+void BasicVectorBatch<Layout>::add_vector( const float *v,int n ) {
+  assert( not Layout::transposed );
   const int Nelements = vals.size();
-  const int vector_length = v.size();
+  const int vector_length = n;
   if (Nelements==0)
     set_item_size(vector_length);
   else {
@@ -76,47 +97,54 @@ void VectorBatch::add_vector( const std::vector<float> &v ) {
   const int m = Nelements/vector_length;
   vals.resize(Nelements+vector_length); nvectors++;
   for (int i = 0; i < vector_length; i++) {
-    vals.at( m * vector_length + i ) = v.at(i);
+    vals.at( m * vector_length + i ) = v[i];
   };
 };
 
-std::vector<float> VectorBatch::get_col(int j) const {
-  assert( j<batch_size() );
-  const int c = item_size();
-  std::vector<float> col(c);
-  for (int i=0; i<c; i++)
-    col.at(i) = vals.at( j + c*i );
-  return col;
+template< typename Layout >
+std::vector<float> BasicVectorBatch<Layout>::get_col(int j) const {
+  return extract_vector(j);
 };
 
-void VectorBatch::set_row( int j, const std::vector<float> &v ) {
-  const int c = item_size();
-  assert( v.size()==c );
-  for (int i = 0; i < c; i++) {
-    vals.at( j * c + i ) = v.at(i);
+//! row i: element i of every vector
+template< typename Layout >
+void BasicVectorBatch<Layout>::set_row( int i, const std::vector<float> &v ) {
+  assert( i<item_size() );
+  assert( v.size()==batch_size() );
+  for (int j = 0; j < batch_size(); j++) {
+    vals.at( index(i,j) ) = v.at(j);
   };
 }
 
-std::vector<float> VectorBatch::get_row(int j) const {
-  assert( j<batch_size() );
-  const int n = item_size();
+template< typename Layout >
+std::vector<float> BasicVectorBatch<Layout>::get_row(int i) const {
+  assert( i<item_size() );
+  const int n = batch_size();
   std::vector<float> row(n);
-  for (int i = 0; i < n; i++)
-    row.at(i) = vals.at( j * n + i );
+  for (int j = 0; j < n; j++)
+    row.at(j) = vals.at( index(i,j) );
   return row;
 };
 
-std::vector<float> VectorBatch::extract_vector(int j) const {
+template< typename Layout >
+std::vector<float> BasicVectorBatch<Layout>::extract_vector(int j) const {
   assert( j<batch_size() );
-  const int m = item_size();
-  std::vector<float> v(m);
-  for (int i = 0; i < m; i++)
-    v.at(i) = vals.at( INDEXc(i,j,m,batch_size()) );  // (j * n + i );
-  return v;
-  //  return get_row(v);
+  if constexpr (not Layout::transposed) {
+    // vector j is contiguous
+    const float *v = vals.data()+index(0,j);
+    return std::vector<float>( v,v+item_size() );
+  } else {
+    std::vector<float> v( item_size() );
+    for (int i=0; i<item_size(); i++)
+      v[i] = vals.at( index(i,j) );
+    return v;
+  }
 };
 #ifdef USE_GSL
-gsl::span<float> VectorBatch::get_vector(int v) {
+//! sample major only: a span is contiguous
+template< typename Layout >
+gsl::span<float> BasicVectorBatch<Layout>::get_vector(int v) {
+  assert( not Layout::transposed );
   const int c = item_size();
   return gsl::span<float>( &vals[v*c], c );
 };
@@ -125,24 +153,40 @@ gsl::span<float> VectorBatch::get_vector(int v) {
 //   return gsl::span<float>( data(v*c) /* &vals[v*c] */, c );
 // };
 #else
-std::vector<float> VectorBatch::get_vector(int v) const {
+template< typename Layout >
+std::vector<float> BasicVectorBatch<Layout>::get_vector(int v) const {
   return extract_vector(v);
 };
 #endif
 
-void VectorBatch::set_vector( const Vector &v, int j) {
+template< typename Layout >
+void BasicVectorBatch<Layout>::set_vector( const Vector &v, int j) {
   const int c = item_size();
   assert( v.size()==c );
+  assert( j<batch_size() );
   for (int i=0; i<c; i++)
-    vals.at( j * c + i ) = v.vals.at(i); 
+    vals[ index(i,j) ] = v.vals[i];
 }
 
-void VectorBatch::addh(const Vector &y) { // Add y to every row
+template< typename Layout >
+void BasicVectorBatch<Layout>::addh(const Vector &y) { // Add y to every row
   const int r = item_size(), c = batch_size(); 
   assert( r==y.size() );
-  for (int j=0; j<c; j++ ) {
-    for (int i=0; i<r; i++) {
-      vals.at( INDEXc(i,j,r,c) ) += y.vals[i];
+  float *v = vals.data(); const float *yv = y.vals.data();
+  if constexpr (Layout::transposed) {
+    // the rows are contiguous
+#pragma omp parallel for if(r*c>=parallel_threshold())
+    for (int i=0; i<r; i++ ) {
+      for (int j=0; j<c; j++) {
+	v[ index(i,j) ] += yv[i];
+      }
+    }
+  } else {
+#pragma omp parallel for if(r*c>=parallel_threshold())
+    for (int j=0; j<c; j++ ) {
+      for (int i=0; i<r; i++) {
+	v[ index(i,j) ] += yv[i];
+      }
     }
   }
 }
@@ -153,110 +197,336 @@ void VectorBatch::addh(const Vector &y) { // Add y to every row
 //   asserr( c==y.batch_size() );
 //   for (int j=0; j<c; j++ ) {
 //     for (int i=0; i<r; i++) {
-//       vals.at( INDEXc(i,j,r,c) ) += y.vals.at( INDEXc(i,j,r,c) );
+//       vals.at( index(i,j) ) += y.vals.at( index(i,j) );
 //     }
 //   }
 // }
 
-Vector VectorBatch::meanh() const { // Returns a vector of row-wise means
-  const int r = item_size(), c = batch_size();
-  Vector mean(r, 0);
-  for (int i=0; i<r; i++) {
-    float avg = 0.f;
-    for ( int j=0; j<c; j++ ) {
-      avg += vals.at( INDEXc(i,j,r,v) );
-    }
-    mean.vals[i] = avg/static_cast<float>( item_size() );
-  }
+template< typename Layout >
+Vector BasicVectorBatch<Layout>::meanh() const { // Returns a vector of row-wise means
+  Vector mean(item_size(), 0);
+  meanh(mean);
   return mean;
 }
 
-
-/*
- * VLE dangerous. et rid of this one
- */
-VectorBatch &VectorBatch::operator=(const VectorBatch &m2) { // Overloading the = operator
-  set_item_size( m2.item_size() );
-  set_batch_size( m2.batch_size() );
-
-  this->vals = m2.vals; // IM Since we're using vectors we can just use the assignment from that
-
-  return *this;
+template< typename Layout >
+void BasicVectorBatch<Layout>::meanh( Vector &mean ) const { // Same, into existing storage
+  sumh( mean );
+  float *avg = mean.vals.data();
+  for (int i=0; i<item_size(); i++)
+    avg[i] /= static_cast<float>( batch_size() );
 }
 
-
-VectorBatch VectorBatch::operator-(const VectorBatch &m2) {
-  assert( item_size()==m2.item_size() );
-  assert( batch_size()==m2.batch_size() );
-  const int c = m2.item_size(), r = m2.batch_size();
-  VectorBatch out(r, c, 0);
-    for (int i = 0; i < r * c; i++) {
-        out.vals[i] = this->vals[i] - m2.vals[i];
+template< typename Layout >
+void BasicVectorBatch<Layout>::sumh( Vector &sum ) const { // Row-wise sums, into existing storage
+  const int r = item_size(), c = batch_size();
+  assert( sum.size()==r );
+  float *s = sum.vals.data();
+  if constexpr (Layout::transposed) {
+    // a row is contiguous: one sum per row
+    for (int i=0; i<r; i++) {
+      const float *v = vals.data()+index(i,0);
+      float si{0.f};
+      for ( int j=0; j<c; j++ )
+	si += v[j];
+      s[i] = si;
     }
-    return out;
-}
-
-VectorBatch VectorBatch::operator*(const VectorBatch &m2) { // Hadamard product
-  assert( item_size()==m2.item_size() );
-  assert( batch_size()==m2.batch_size() );
-  const int c = m2.item_size(), r = m2.batch_size();
-  VectorBatch out(r, c, 0);
-  for (int i = 0; i < nelements(); i++) {
-        out.vals[i] = this->vals[i] * m2.vals[i];
+  } else {
+    // accumulate vector by vector, going through the storage in order
+    std::fill( s,s+r,0.f );
+    for ( int j=0; j<c; j++ ) {
+      const float *v = vals.data()+index(0,j);
+      for (int i=0; i<r; i++)
+	s[i] += v[i];
     }
-    return out;
+  }
 }
 
-void VectorBatch::hadamard(const VectorBatch& m1,const VectorBatch& m2) {
+
+
+template< typename Layout >
+void BasicVectorBatch<Layout>::hadamard(const BasicVectorBatch& m1,const BasicVectorBatch& m2) {
   const int r = item_size(), c = batch_size();
   assert( r==m1.item_size() ); assert( c==m1.batch_size() );
   assert( r==m2.item_size() ); assert( c==m2.batch_size() );
 
   const auto& m1vals = m1.vals_vector();
   const auto& m2vals = m2.vals_vector();
+#pragma omp parallel for if(r*c>=parallel_threshold())
   for (int i=0; i<r*c; i++) {
         vals[i] = m1vals[i] * m2vals[i];
   }
 }
 
-VectorBatch VectorBatch::operator/(const VectorBatch &m2) { // Hadamard product
-  const int c = m2.item_size(), r = m2.batch_size();
-  assert( item_size()==c );
-  assert( batch_size()==r );
-  VectorBatch out(r, c, 0);
-  for (int i = 0; i < nelements(); i++) {
-    out.vals[i] = this->vals[i] / m2.vals[i];
+template< typename Layout >
+void BasicVectorBatch<Layout>::scaleby( float f) {
+  const int n = nelements();
+#pragma omp parallel for if(n>=parallel_threshold())
+  for (int i = 0; i < n; i++) {
+    vals[i] /= f;
   }
-  return out;
 }
 
-void VectorBatch::scaleby( float f) {
-  for (int i = 0; i < nelements(); i++) {
-    vals[i] /= f;
+/*
+ * The products with the layer weights, for every pair of layouts.
+ * They all go through blas.h, whatever the backend.
+ * A row-major matrix is the transpose of a column-major one;
+ * a batch is an item_size x batch_size matrix if it is sample major,
+ * and the transpose of that if it is feature major, see vector2.h.
+ * Each product is computed as is if the output batch is sample major,
+ * and transposed if it is feature major, so that the output is
+ * the C of the gemm either way, and the inputs only change transpose flags.
+ */
+
+// y = x x
+template< typename Layout > template< typename YLayout >
+void BasicVectorBatch<Layout>::v2mp(const Matrix &m, BasicVectorBatch<YLayout> &y) const {
+  const int
+    xr = item_size(),   xc = batch_size(),   // column storage
+    mr = m.rowsize(),   mc = m.colsize(),    // row storage
+    ml = m.leading_dimension(),              // row length, padded
+    yr = y.item_size(), yc = y.batch_size(); // column
+
+  if (trace_scalars())
+    cout << "matrix vector product "
+	 << mr << "x" << mc
+	 << " & "
+	 << xr << "x" << xc
+	 << " => " << yr << "x" << yc
+	 << endl;
+
+  assert( xc==yc );
+  assert( yr==mr );
+  assert( mc==xr );
+
+  const auto mmat  = m.values().data();
+  const auto xvals = vals_vector().data();
+  auto       yvals = y.vals_vector().data();
+
+  if constexpr (not YLayout::transposed)
+    // row major matrix times the batch
+    blas_sgemm( true,Layout::transposed, yr,yc,mc,
+		1.f,
+		mmat,  /* lda */ ml,
+		xvals, /* ldb */ leading_dimension(),
+		0.f,
+		yvals, /* ldc */ y.leading_dimension()
+		);
+  else
+    // y^t = self^t m^t, and m^t is the matrix by columns
+    blas_sgemm( not Layout::transposed,false, yc,yr,mc,
+		1.f,
+		xvals, /* lda */ leading_dimension(),
+		mmat,  /* ldb */ ml,
+		0.f,
+		yvals, /* ldc */ y.leading_dimension()
+		);
+}
+
+/*
+ * Forward product with bias and activation applied
+ * to y while it is still in cache,
+ * instead of separate passes for addh and the activation.
+ * The fused kernels add the bias by row of their output,
+ * which for a feature-major y is a sample: there we do the product,
+ * then one sweep over the features, each a contiguous row of y.
+ */
+template< typename Layout > template< typename YLayout >
+void BasicVectorBatch<Layout>::v2mp_bias_act
+    (const Matrix &m, const Vector &b, acFunc f, BasicVectorBatch<YLayout> &y, int approximation) const {
+  const int
+    xr = item_size(),   xc = batch_size(),   // column storage
+    mr = m.rowsize(),   mc = m.colsize(),    // row storage
+    ml = m.leading_dimension(),              // row length, padded
+    yr = y.item_size(), yc = y.batch_size(); // column
+
+  if (trace_scalars())
+    cout << "fused matrix vector product "
+	 << mr << "x" << mc
+	 << " & "
+	 << xr << "x" << xc
+	 << " => " << yr << "x" << yc
+	 << endl;
+
+  assert( xc==yc );
+  assert( yr==mr );
+  assert( mc==xr );
+  assert( b.size()==yr );
+
+  const auto mmat  = m.values().data();
+  const auto xvals = vals_vector().data();
+  auto       yvals = y.vals_vector().data();
+
+  if constexpr (not YLayout::transposed) {
+    blas_sgemm_bias_act( true,Layout::transposed, yr,yc,mc,
+			 mmat,  /* lda */ ml,
+			 xvals, /* ldb */ leading_dimension(),
+			 yvals, /* ldc */ y.leading_dimension(),
+			 b.data(),f,approximation
+			 );
+  } else {
+    v2mp( m,y );
+    const float *bias = b.data();
+    with_elementwise_activation
+      ( f,[&] ( auto act ) {
+	using Act = decltype(act);
+#pragma omp parallel for if(yr*yc>=parallel_threshold())
+	for (int i=0; i<yr; i++) {
+	  float *feature = yvals+y.index(i,0);
+	  for (int j=0; j<yc; j++)
+	    feature[j] += bias[i];
+	  if constexpr (not Act::linear)
+	    Act::array( yc,feature,feature,approximation );
+	}
+      } );
   }
 }
 
-VectorBatch VectorBatch::operator-() {
-    VectorBatch result = *this;
-    for (int i = 0; i < nelements(); i++) {
-        result.vals[i] = -vals[i];
-    }
+// matrix transpose x self => y
+template< typename Layout > template< typename YLayout >
+void BasicVectorBatch<Layout>::v2mtp(const Matrix &m, BasicVectorBatch<YLayout> &y) const {
+  const int
+    xr = item_size(),   xc = batch_size(),   // column storage
+    mr = m.rowsize(),   mc = m.colsize(),    // row storage
+    ml = m.leading_dimension(),              // row length, padded
+    yr = y.item_size(), yc = y.batch_size(); // column
 
-    return result;
-};
+  if (trace_scalars())
+    cout << "matrix transpose vector product "
+	 << mr << "x" << mc
+	 << " & "
+	 << xr << "x" << xc
+	 << " => " << yr << "x" << yc
+	 << endl;
 
-VectorBatch operator/(const VectorBatch &m, const float &c) {
-    VectorBatch o = m;
-    for (int i = 0; i < m.nelements(); i++) {
-        o.vals[i] = o.vals[i] / c;
-    }
-    return o;
+  assert( xc==yc );
+  assert( yr==mc );
+  assert( mr==xr );
+
+  const auto mmat  = m.values().data();
+  const auto xvals = vals_vector().data();
+  auto       yvals = y.vals_vector().data();
+
+  if constexpr (not YLayout::transposed)
+    // matrix is by rows, so its transpose is by columns
+    blas_sgemm( false,Layout::transposed, yr,yc,mr,
+		1.f,
+		mmat,  /* lda */ ml,
+		xvals, /* ldb */ leading_dimension(),
+		0.f,
+		yvals, /* ldc */ y.leading_dimension()
+		);
+  else
+    // y^t = self^t m
+    blas_sgemm( not Layout::transposed,true, yc,yr,mr,
+		1.f,
+		xvals, /* lda */ leading_dimension(),
+		mmat,  /* ldb */ ml,
+		0.f,
+		yvals, /* ldc */ y.leading_dimension()
+		);
 }
 
-VectorBatch operator*(const float &c, const VectorBatch &m) {
-    VectorBatch o = m;
-    for (int i = 0; i < m.nelements(); i++) {
-        o.vals[i] = o.vals[i] * c;
-    }
-    return o;
+/*
+ * Backward product with the activation derivative,
+ * computed from the activated values a,
+ * applied to y while it is still in cache,
+ * instead of a separate gradient batch and hadamard product.
+ * The derivative is elementwise, so it is the same for y and y^t.
+ */
+template< typename Layout > template< typename YLayout >
+void BasicVectorBatch<Layout>::v2mtp_act_grad
+    (const Matrix &m, const BasicVectorBatch<YLayout> &a, acFunc f, BasicVectorBatch<YLayout> &y) const {
+  const int
+    xr = item_size(),   xc = batch_size(),   // column storage
+    mr = m.rowsize(),   mc = m.colsize(),    // row storage
+    ml = m.leading_dimension(),              // row length, padded
+    yr = y.item_size(), yc = y.batch_size(); // column
+
+  if (trace_scalars())
+    cout << "fused matrix transpose vector product "
+	 << mr << "x" << mc
+	 << " & "
+	 << xr << "x" << xc
+	 << " => " << yr << "x" << yc
+	 << endl;
+
+  assert( xc==yc );
+  assert( yr==mc );
+  assert( mr==xr );
+  assert( a.item_size()==yr and a.batch_size()==yc );
+
+  const auto mmat  = m.values().data();
+  const auto xvals = vals_vector().data();
+  auto       yvals = y.vals_vector().data();
+
+  if constexpr (not YLayout::transposed)
+    // matrix is by rows, so its transpose is by columns
+    blas_sgemm_act_grad( false,Layout::transposed, yr,yc,mr,
+			 mmat,  /* lda */ ml,
+			 xvals, /* ldb */ leading_dimension(),
+			 yvals, /* ldc */ y.leading_dimension(),
+			 a.data(),f
+			 );
+  else
+    blas_sgemm_act_grad( not Layout::transposed,true, yc,yr,mr,
+			 xvals, /* lda */ leading_dimension(),
+			 mmat,  /* ldb */ ml,
+			 yvals, /* ldc */ y.leading_dimension(),
+			 a.data(),f
+			 );
 }
+
+/*
+ * x times self => m
+ */
+template< typename Layout > template< typename XLayout >
+void BasicVectorBatch<Layout>::outer2(const BasicVectorBatch<XLayout> &x, Matrix &m ) const {
+  const int
+    yr = item_size(),   yc = batch_size(),   // column storage
+    mr = m.rowsize(),   mc = m.colsize(),    // row storage
+    ml = m.leading_dimension(),              // row length, padded
+    xr = x.item_size(), xc = x.batch_size(); // column
+
+  if (trace_scalars())
+    cout << "outer product "
+	 << xr << "x" << xc
+	 << " & "
+	 << yr << "x" << yc
+	 << " => " << mr << "x" << mc
+	 << endl;
+
+  assert( yc==xc );
+  assert( xr==mr );
+  assert( yr==mc );
+  const auto xvals = x.vals_vector().data();
+  const auto yvals =   vals_vector().data();
+  auto       mmat  = m.values().data();
+
+  // by rows m = x self^t, so by columns it is self x^t
+  blas_sgemm( Layout::transposed,not XLayout::transposed, mc,mr,yc,
+	      1.f,
+	      yvals, /* lda */ leading_dimension(),
+	      xvals, /* ldb */ x.leading_dimension(),
+	      0.f,
+	      mmat,  /* ldc */ ml
+	      );
+}
+
+template class BasicVectorBatch<sample_major_layout>;
+template class BasicVectorBatch<feature_major_layout>;
+
+// the products of a batch in layout X with one in layout Y
+#define BATCH_PRODUCTS( X,Y )						\
+  template void BasicVectorBatch<X>::v2mp( const Matrix&,BasicVectorBatch<Y>& ) const; \
+  template void BasicVectorBatch<X>::v2mp_bias_act				\
+  ( const Matrix&,const Vector&,acFunc,BasicVectorBatch<Y>&,int ) const;	\
+  template void BasicVectorBatch<X>::v2mtp( const Matrix&,BasicVectorBatch<Y>& ) const; \
+  template void BasicVectorBatch<X>::v2mtp_act_grad				\
+  ( const Matrix&,const BasicVectorBatch<Y>&,acFunc,BasicVectorBatch<Y>& ) const; \
+  template void BasicVectorBatch<X>::outer2( const BasicVectorBatch<Y>&,Matrix& ) const;
+BATCH_PRODUCTS( sample_major_layout,sample_major_layout )
+BATCH_PRODUCTS( sample_major_layout,feature_major_layout )
+BATCH_PRODUCTS( feature_major_layout,sample_major_layout )
+BATCH_PRODUCTS( feature_major_layout,feature_major_layout )
+#undef BATCH_PRODUCTS
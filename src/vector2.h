@@ -17,6 +17,8 @@
 #include <vector>
 #include "vector.h"
 #include "matrix.h"
+#include "expr.h"
+#include "workspace.h"
 #include <iostream>
 #ifdef BLISNN
 #include "blis/blis.h"
@@ -26,10 +28,43 @@
 #include "gsl/gsl-lite.hpp"
 #endif
 
-#define INDEXr(i,j,m,n) (i)*(n)+(j)
-#define INDEXc(i,j,m,n) (i)+(j)*(m)
+/*
+ * The storage layout of a batch, fixed at compile time:
+ * element i of vector j is at index(i,j,m,n),
+ * with m the item size and n the batch size.
+ *
+ * Sample major: the vectors are stored one after the other,
+ * so per-sample kernels such as softmax, argmax and the loss,
+ * and the slices of VectorBatchView, see contiguous data.
+ * To the column-major blas such a batch is an item_size x batch_size matrix
+ * with leading dimension item_size: the vectors are its columns,
+ * and that is also how show() prints it.
+ *
+ * Feature major: element i of all vectors is stored together,
+ * so the elementwise work of a layer goes by long contiguous rows
+ * of one feature, whatever the item size.
+ * To the blas this is the transpose of the above, a batch_size x item_size
+ * matrix with leading dimension batch_size; the products pass
+ * their transpose flags accordingly, see vector2.cpp.
+ */
+struct sample_major_layout {
+  static constexpr bool transposed = false;
+  static int index( int i,int j,int m,int /* n */ ) { return i+j*m; };
+  static int leading_dimension( int m,int /* n */ ) { return m; };
+};
+struct feature_major_layout {
+  static constexpr bool transposed = true;
+  static int index( int i,int j,int /* m */,int n ) { return j+i*n; };
+  static int leading_dimension( int /* m */,int n ) { return n; };
+};
+
+// the same as a run-time choice, for the batches of a layer: see Net::addLayer
+enum batch_layout { sample_major, feature_major };
 
-class VectorBatch{
+enum acFunc : int; // see funcs.h
+
+template< typename Layout >
+class BasicVectorBatch{
   friend class Matrix;
   friend class Vector;
 
@@ -51,13 +86,16 @@ class VectorBatch{
 #endif
 
 private: //private:
-  std::vector<float> vals;
+  batch_storage vals;
   int nvectors{0},vector_size{0};
 public:
-    VectorBatch();
-    VectorBatch( int itemsize );
+    BasicVectorBatch();
+    BasicVectorBatch( int itemsize );
     // this one is in the blis/reference file
-    VectorBatch(int nRows, int nCols, bool rand=false);
+    BasicVectorBatch(int nRows, int nCols, bool rand=false);
+    // evaluate an elementwise expression, see expr.h
+    template< typename E >
+    BasicVectorBatch( const expr<E> &e ) { *this = e; };
     void allocate(int,int);
 
     int size() const { return vals.size(); };
@@ -73,17 +111,21 @@ public:
       return sqrt(norm);
     };
     bool notnan() const {
-      return all_of
+      return std::all_of
 	( vals.begin(),vals.end(),
 	  [] (float e) { return not isnan(e); }
 	);
     }
     bool notinf() const {
-      return all_of
+      return std::all_of
 	( vals.begin(),vals.end(),
 	  [] (float e) { return not isinf(e); }
 	);
     }
+    using layout = Layout;
+    //! where element i of vector j is stored
+    int index( int i,int j ) const { return Layout::index(i,j,vector_size,nvectors); };
+    int leading_dimension() const { return Layout::leading_dimension(vector_size,nvectors); };
     int item_size() const { return vector_size; };
     void set_item_size(int n) { vector_size = n; };
     int batch_size() const { return nvectors; };
@@ -94,23 +136,48 @@ public:
       return n;
     };
   //    VectorBatch transpose() const;
-    std::vector<float>& vals_vector() { return vals; };
-    const std::vector<float>& vals_vector() const { return vals; };
+    batch_storage& vals_vector() { return vals; };
+    const batch_storage& vals_vector() const { return vals; };
+    //! keep the values in a slice of the workspace, for up to n floats
+    void use_workspace( Workspace &w,int n ) { use_storage( w.carve(n),n ); };
+    //! keep the values in the n floats at p, which someone else owns
+    void use_storage( float *p,int n ) { vals.borrow( p,n ); };
+    //! read the values in the n floats at p, copying them on the first write
+    void view_storage( const float *p,int n ) { vals.view( p,n ); };
+    //! free the values, or stop viewing them
+    void release() { vals.release(); nvectors = 0; };
     float *data() { return vals.data(); };
     const float *data() const { return vals.data(); };
     const float *data( int disp ) const { return vals.data()+disp; };
 
 	
-	void v2mp( const Matrix &x, VectorBatch &y) const;
-    void v2tmp( const Matrix &x, VectorBatch &y ) const;
-	void v2mtp( const Matrix &x, VectorBatch &y ) const;
-	void outer2( const VectorBatch &x, Matrix &y ) const;
+	// the other batch of a product can have either layout
+	template< typename YLayout >
+	void v2mp( const Matrix &x, BasicVectorBatch<YLayout> &y) const;
+    void v2tmp( const Matrix &x, BasicVectorBatch &y ) const;
+	template< typename YLayout >
+	void v2mtp( const Matrix &x, BasicVectorBatch<YLayout> &y ) const;
+	template< typename XLayout >
+	void outer2( const BasicVectorBatch<XLayout> &x, Matrix &y ) const;
+	// y = act( x self + b ), fused; for SMAX only the bias is applied;
+	// the exponential of degree approximation, see vmath.h
+	template< typename YLayout >
+	void v2mp_bias_act( const Matrix &x, const Vector &b, acFunc f, BasicVectorBatch<YLayout> &y,
+			    int approximation=0 ) const;
+	// y = ( x^t self ) .* f'( a ), fused, with a in the layout of y; SMAX is treated as NONE
+	template< typename YLayout >
+	void v2mtp_act_grad( const Matrix &x, const BasicVectorBatch<YLayout> &a, acFunc f,
+			     BasicVectorBatch<YLayout> &y ) const;
 	
-  void add_vector( const std::vector<float> &v );
+  // sample major only: the new vector goes at the end of the storage
+  void add_vector( const float *v,int n );
+  void add_vector( const std::vector<float> &v ) { add_vector( v.data(),v.size() ); };
+  void add_vector( const aligned_vector &v ) { add_vector( v.data(),v.size() ); };
+  // rows and columns of the item_size x batch_size matrix: column j is vector j
   void set_col(int j,const std::vector<float> &v );
   std::vector<float> get_col(int j) const;
-  void set_row( int j, const std::vector<float> &v );
-  std::vector<float> get_row(int j) const;
+  void set_row( int i, const std::vector<float> &v );
+  std::vector<float> get_row(int i) const;
   std::vector<float> extract_vector(int v) const;
 #ifdef USE_GSL
   gsl::span<float> get_vector(int v);
@@ -121,9 +188,10 @@ public:
   void set_vector( const Vector &v, int j);
 
   Vector get_vectorObj(int j) const {
+    assert( j<batch_size() );
     Vector vec(vector_size,0);
-    for (int i = 0; i < vector_size; i++ ) 
-      vec.vals.at(i) = vals.at( j * vector_size + i );
+    for (int i=0; i<vector_size; i++)
+      vec.vals[i] = vals[ index(i,j) ];
     return vec;
   }
 
@@ -132,18 +200,59 @@ public:
   void display(std::string) const;
 
   void addh(const Vector &y);
-  void addh(const VectorBatch &y);
+  void addh(const BasicVectorBatch &y);
   Vector meanh() const;
+  void meanh( Vector& ) const;
+  void sumh( Vector& ) const;
 	
-  VectorBatch operator-(); // Unary negate operator
-  VectorBatch& operator=(const VectorBatch& m2); // Copy constructor
-  void hadamard(const VectorBatch& m1,const VectorBatch& m2);
-  VectorBatch operator*(const VectorBatch &m2); // Hadamard Product Element-wise multiplication
-  VectorBatch operator/(const VectorBatch &m2); // Element-wise division
+  // plain copies and moves of the values
+  BasicVectorBatch( const BasicVectorBatch& ) = default;
+  BasicVectorBatch( BasicVectorBatch&& ) = default;
+  BasicVectorBatch& operator=( const BasicVectorBatch& ) = default;
+  BasicVectorBatch& operator=( BasicVectorBatch&& ) = default;
+  // Element-wise +,-,*,/, and with a scalar, are expressions: see expr.h;
+  // all operands have the same layout, so this goes through the storage in order
+  template< typename E >
+  BasicVectorBatch& operator=( const expr<E> &e ) {
+    const BasicVectorBatch &s = e.self().shape();
+    allocate( s.batch_size(),s.item_size() );
+    expr_evaluate( e,vals.data() );
+    return *this;
+  };
+  void hadamard(const BasicVectorBatch& m1,const BasicVectorBatch& m2);
   void scaleby( float );
-  VectorBatch operator-(const VectorBatch &m2); // Element-wise subtraction
-  friend VectorBatch operator/(const VectorBatch &m, const float &c); // for matrix-constant division
-  friend VectorBatch operator*(const float &c, const VectorBatch &m); // for matrix-constant division
+};
+
+using VectorBatch = BasicVectorBatch<sample_major_layout>;
+using FeatureMajorBatch = BasicVectorBatch<feature_major_layout>;
+
+template< typename Layout >
+struct expr_container< BasicVectorBatch<Layout> > : std::true_type {
+  static int size( const BasicVectorBatch<Layout> &v ) { return v.size(); };
+};
+
+/*
+ * A range of the vectors of a batch, without copying.
+ * The vectors of a batch are stored one after the other,
+ * so this is the slice from vector `first' on, with stride item_size;
+ * it is a VectorBatch, so it goes wherever a VectorBatch goes:
+ * layers, kernels, expressions.
+ * It never writes the parent: the first non-const access to its values,
+ * or growing it, copies them into storage of its own.
+ * Until then it is only valid as long as
+ * the parent batch is not resized or destroyed.
+ * Copying it gives an ordinary batch with its own values.
+ */
+class VectorBatchView : public VectorBatch {
+public:
+  VectorBatchView( const VectorBatch &parent,int first,int n );
+};
+
+// in expressions a view is just a batch
+template<>
+struct expr_operand<VectorBatchView> {
+  using type = expr_leaf<VectorBatch>;
+  static type make( const VectorBatch &t ) { return type(t); };
 };
 
 
@@ -23,7 +23,7 @@
 
 Vector::Vector(int s, int init) {
 	r = s;
-  vals = std::vector<float>(s);
+  vals = aligned_vector(s);
   float scal_fac = 0.05;
   if (init==0){
     float zero = 0.0;
@@ -19,7 +19,7 @@
 
 Vector::Vector(int s, int init) {
 	r = s;
-  vals = std::vector<float>(s);
+  vals = aligned_vector(s);
   if (init==0){
     std::fill(vals.begin(),vals.end(), 0);
   }else if (init==1){
@@ -11,7 +11,10 @@
  ****************************************************************
  ****************************************************************/
 
+#include "trace.h"
 #include "vector2.h"
+#include "blas.h"
+#include "funcs.h"
 #include <iostream>
 using std::cout;
 using std::endl;
@@ -24,19 +27,23 @@ using std::vector;
 #include "blis/blis.h"
 #endif
 
-VectorBatch::VectorBatch(int nRows, int nCols, bool random) {
+template< typename Layout >
+BasicVectorBatch<Layout>::BasicVectorBatch(int nRows, int nCols, bool random) {
   allocate(nRows,nCols);
-  const int r=nRows, c=nCols;
+  // as an item_size x batch_size matrix, with the strides of the layout
+  const int r=item_size(), c=batch_size(),
+    rs = ( Layout::transposed ? leading_dimension() : 1 ),
+    cs = ( Layout::transposed ? 1 : leading_dimension() );
 
   float scal_fac = 0.05; // randomize between (-scal;scal)
   if (not random){
     float zero = 0.0;
     bli_ssetm( BLIS_NO_CONJUGATE, 0, BLIS_NONUNIT_DIAG, BLIS_DENSE,
-	       r, c, &zero, &vals[0], c, 1);
+	       r, c, &zero, &vals[0], rs, cs);
   } else if (random){
-    bli_srandm(0, BLIS_DENSE, r, c, &vals[0], c, 1);
+    bli_srandm(0, BLIS_DENSE, r, c, &vals[0], rs, cs);
     bli_sscalm( BLIS_NO_CONJUGATE, 0, BLIS_NONUNIT_DIAG, BLIS_DENSE,
-		r, c, &scal_fac, &vals[0], c, 1);
+		r, c, &scal_fac, &vals[0], rs, cs);
   }
 }
 		
@@ -49,55 +56,26 @@ VectorBatch::VectorBatch(int nRows, int nCols, bool random) {
 //     return result;
 // }
 
-void VectorBatch::show() const {
+template< typename Layout >
+void BasicVectorBatch<Layout>::show() const {
 
     const int c = batch_size(), r = item_size();
 	char e[5] = "";
 	char forvals[8] = "%4.4f";
-	bli_sprintm( e, r, c, const_cast<float*>(&vals[0]), c, 1, forvals, e );
+	const int ld = leading_dimension();
+	bli_sprintm( e, r, c, const_cast<float*>(&vals[0]),
+		     ( Layout::transposed ? ld : 1 ), ( Layout::transposed ? 1 : ld ), forvals, e );
 }
 
-
 /*
  * For explanation of the BLIS routines, see
  * https://github.com/flame/blis/blob/master/docs/BLISTypedAPI.md#gemm
  * and
  * https://github.com/flame/blis/blob/master/docs/BLISTypedAPI.md#computational-function-reference
+ * The products that the layers use go through blas.h, see vector2.cpp;
+ * this one is only there for sample-major batches.
  */
-void VectorBatch::v2mp(const Matrix &m, VectorBatch &y) const {
-  const int
-    xr = item_size(),   xc = batch_size(),   // column storage
-    mr = m.rowsize(),   mc = m.colsize(),    // row storage
-    yr = y.item_size(), yc = y.batch_size(); // column
-
-  if (trace_scalars())
-    cout << "matrix vector product "
-	 << mr << "x" << mc
-	 << " & "
-	 << xr << "x" << xc
-	 << " => " << yr << "x" << yc
-	 << endl;
-
-  assert( xc==yc );
-  assert( yr==mr );
-  assert( mc==xr );
-
-  const auto& mmat  = m.values().data();
-  const auto& xvals = vals_vector().data();
-  auto  yvals       = y.vals_vector().data();
-
-  float alpha = 1.0;
-  float beta = 0.0;
-  bli_sgemm( BLIS_NO_TRANSPOSE, BLIS_NO_TRANSPOSE, 
-	     yr,yc,mc,
-	     &alpha,
-	     const_cast<float*>(mmat),  /* rsa,csa */ mr,1,
-	     const_cast<float*>(xvals), /* rsb,csb */ 1,xr,
-	     &beta,
-	     yvals,                     /* rsc,csc */ 1,yr
-	     );
-}
-
+template<>
 void VectorBatch::v2tmp(const Matrix &x, VectorBatch &y) const {
 
     const int c = batch_size(), r = item_size();
@@ -111,78 +89,10 @@ void VectorBatch::v2tmp(const Matrix &x, VectorBatch &y) const {
 	bli_sgemm( BLIS_TRANSPOSE, BLIS_NO_TRANSPOSE, 
 		   c, x.colsize(), r, &alpha, const_cast<float*>(&vals[0]),
 		   c, 1, const_cast<float*>( x.data() ),
-		   x.colsize(), 1, &beta, &y.vals[0], x.colsize(), 1);
+		   x.leading_dimension(), 1, &beta, &y.vals[0], x.colsize(), 1);
 }
 
-// matrix transpose x self => y
-void VectorBatch::v2mtp(const Matrix &m, VectorBatch &y) const {
-  const int
-    xr = item_size(),   xc = batch_size(),   // column storage
-    mr = m.rowsize(),   mc = m.colsize(),    // row storage
-    yr = y.item_size(), yc = y.batch_size(); // column
-
-  if (trace_scalars())
-    cout << "matrix transpose vector product "
-	 << mr << "x" << mc
-	 << " & "
-	 << xr << "x" << xc
-	 << " => " << yr << "x" << yc
-	 << endl;
-
-  assert( xc==yc );
-  assert( yr==mc );
-  assert( mr==xr );
-
-  const auto& mmat  = m.values().data();
-  const auto& xvals = vals_vector().data();
-  auto        yvals = y.vals_vector().data();
-
-  float alpha = 1.0;
-  float beta = 0.0;
-  bli_sgemm( BLIS_NO_TRANSPOSE, BLIS_NO_TRANSPOSE, 
-	     yr,yc,mr,
-	     &alpha,
-	     const_cast<float*>(mmat),  /* rsa,csa */ 1,mc,
-	     const_cast<float*>(xvals), /* rsb,csb */ 1,xr,
-	     &beta,
-	     yvals,                     /* rsc,csc */ 1,yr
-	     );
-
-}
-
-/*
- * x times self => m
- */
-void VectorBatch::outer2(const VectorBatch &x, Matrix &m) const {
-  const int
-    yr = item_size(),   yc = batch_size(),   // column storage
-    mr = m.rowsize(),   mc = m.colsize(),    // row storage
-    xr = x.item_size(), xc = x.batch_size(); // column
-
-  if (trace_scalars())
-    cout << "outer product "
-	 << xr << "x" << xc
-	 << " & "
-	 << yr << "x" << yc
-	 << " => " << mr << "x" << mc
-	 << endl;
-
-  assert( yc==xc );
-  assert( xr==mr );
-  assert( yr==mc );
-  const auto& xvals = x.vals_vector().data();
-  const auto& yvals =   vals_vector().data();
-  auto        mmat  = m.values().data();
-
-  float alpha = 1.0;
-  float beta = 0.0;
-  bli_sgemm( BLIS_NO_TRANSPOSE, BLIS_TRANSPOSE, 
-	     mr,mc,yc,
-	     &alpha,
-	     const_cast<float*>(xvals), /* rsa,csa */ 1,xr,
-	     const_cast<float*>(yvals), /* rsb,csb */ 1,yr,
-	     &beta,
-	     mmat,                      /* rsc,csc */ mc,1
-	     );
-
-}
+template BasicVectorBatch<sample_major_layout>::BasicVectorBatch(int,int,bool);
+template BasicVectorBatch<feature_major_layout>::BasicVectorBatch(int,int,bool);
+template void BasicVectorBatch<sample_major_layout>::show() const;
+template void BasicVectorBatch<feature_major_layout>::show() const;
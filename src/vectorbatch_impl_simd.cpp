@@ -0,0 +1,77 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of 
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code 
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "trace.h"
+#include "vector2.h"
+#include "blas.h"
+#include <iostream>
+using std::cout;
+using std::endl;
+#include <vector>
+using std::vector;
+#include <algorithm>
+
+/*
+ * The batched products go through blas.h, see vector2.cpp,
+ * where the hand-vectorized gemm is one of the backends.
+ * Storage conventions are as in the reference implementation.
+ */
+
+template< typename Layout >
+BasicVectorBatch<Layout>::BasicVectorBatch(int batchsize, int itemsize, bool random) {
+  allocate(batchsize,itemsize);
+
+  int i, j;
+  if (not random){
+    std::fill(vals.begin(), vals.end(), 0);
+  }else if (random){
+    for (i=0; i<batchsize * itemsize;i++){
+      vals[i] = -0.1 + static_cast <float> (rand()) /( static_cast <float>(RAND_MAX/(0.1-(-0.1))));
+    }
+  }
+}
+		
+// VectorBatch VectorBatch::transpose() const {
+//     const int c = batch_size(), r = item_size();
+//      // Initialize a new matrix with inverted dimension values
+//     VectorBatch result(item_size(),batch_size(), 0);
+//     int i1, i2; // Old and new index
+//     for (int i = 0; i < r; i++) {
+//         for (int j = 0; j < c; j++) {
+//             i1 = i * c + j; // Old indexing
+//             i2 = j * r + i; // New indexing
+
+//             result.vals[i2] = vals[i1]; // Move transposed values to new array
+//         }
+//     }
+//     return result;
+// }
+
+template< typename Layout >
+void BasicVectorBatch<Layout>::show() const {
+    const int c = batch_size(), r = item_size();
+    int i, j;
+    for (i = 0; i < r; i++) {
+        for (j = 0; j < c; j++) {
+            std::cout << vals[ index(i,j) ] << ' ';
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// the products are the same for every backend, see vector2.cpp
+template BasicVectorBatch<sample_major_layout>::BasicVectorBatch(int,int,bool);
+template BasicVectorBatch<feature_major_layout>::BasicVectorBatch(int,int,bool);
+template void BasicVectorBatch<sample_major_layout>::show() const;
+template void BasicVectorBatch<feature_major_layout>::show() const;
@@ -0,0 +1,35 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "vmath.h"
+
+/*
+ * The larger of the two columns of the table in vmath.h,
+ * rounded up; the accurate one is a few ulp.
+ */
+float exp_approximation_error( int degree ) {
+  switch (degree) {
+  case 2  : return 1.8e-3f;
+  case 3  : return 7.6e-5f;
+  case 4  : return 2.8e-6f;
+  default : return 3.e-7f;
+  }
+};
+
+int exp_approximation_for( float max_error ) {
+  // a softmax output can be off by twice the error of the exponential
+  for (int d=vmath::exp_approx_lo; d<=vmath::exp_approx_hi; d++)
+    if (2*exp_approximation_error(d)<=max_error)
+      return d;
+  return 0;
+};
@@ -0,0 +1,240 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_VMATH_H
+#define SRC_VMATH_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ * Exponential, sigmoid and tanh for the activations,
+ * as a polynomial instead of a libm call,
+ * so that a loop over them is straight-line code that can be vectorized.
+ *
+ * exp x = 2^n e^r with n = round( x/ln 2 ), |r| <= ln 2 / 2;
+ * r is computed with ln 2 split in two (Cody-Waite)
+ * and e^r = 1 + r + r^2 P(r) with P of degree 5 (the Cephes expf coefficients).
+ * Arguments are clamped to [-87.3,88.3], so there is no overflow,
+ * and no denormals: the result stays between 1.2e-38 and 2e38.
+ * NaN goes through as NaN.
+ *
+ * tanh x is x + x^3 Q(x^2) for |x| < .625, Q of degree 4 (Cephes tanhf),
+ * and 1 - 2/( e^(2|x|)+1 ) with the sign of x beyond that.
+ *
+ * SiLU (swish) x sigma(x) and the tanh form of GELU,
+ *   x ( 1+tanh( sqrt(2/pi) (x + .044715 x^3) ) )/2 = x sigma( 2 sqrt(2/pi) (x + .044715 x^3) ),
+ * are both x / ( 1+e^-z ), with the error of the sigmoid.
+ * ELU is x for x>0, e^x - 1 otherwise; that has an absolute error
+ * of an ulp of 1 near zero, since there is no expm1.
+ *
+ * Maximum error against the exact value, in units in the last place,
+ * found by trying every float in the range:
+ *                with fma (avx2, avx512)   without (sse, scalar)
+ *   exp                1.3                      1.0
+ *   sigmoid            3.2                      2.5   ( before clamping )
+ *   tanh               1.4                      1.4
+ * The sigmoid error is mostly that of exp, for large negative x.
+ */
+
+namespace vmath {
+  constexpr float exp_lo = -87.3f, exp_hi = 88.3f;
+  constexpr float log2e = 1.44269504088896341f;
+  // ln 2 = ln2_hi + ln2_lo, where n*ln2_hi is exact for |n| <= 128
+  constexpr float ln2_hi = 0.693359375f, ln2_lo = -2.12194440e-4f;
+  constexpr float exp_p0 = 1.9875691500e-4f, exp_p1 = 1.3981999507e-3f,
+    exp_p2 = 8.3334519073e-3f, exp_p3 = 4.1665795894e-2f,
+    exp_p4 = 1.6666665459e-1f, exp_p5 = 5.0000001201e-1f;
+  constexpr float tanh_small = .625f, tanh_big = 9.f; // tanh 9 rounds to 1
+  constexpr float tanh_q0 = -5.70498872745e-3f, tanh_q1 = 2.06390887954e-2f,
+    tanh_q2 = -5.37397155531e-2f, tanh_q3 = 1.33314422036e-1f,
+    tanh_q4 = -3.33332819422e-1f;
+  // 2 sqrt(2/pi), and that times .044715
+  constexpr float gelu_a = 1.5957691216f, gelu_b = 7.1354816e-2f;
+};
+
+inline float exp_poly( float x ) {
+  using namespace vmath;
+  x = ( x>exp_hi ? exp_hi : x );
+  x = ( x<exp_lo ? exp_lo : x );
+  // round to nearest by adding and subtracting 1.5 2^23
+  const float magic = 12582912.f;
+  const float n = ( x*log2e + magic ) - magic;
+  const float r = ( x - n*ln2_hi ) - n*ln2_lo;
+  float p = exp_p0;
+  p = p*r + exp_p1; p = p*r + exp_p2; p = p*r + exp_p3;
+  p = p*r + exp_p4; p = p*r + exp_p5;
+  p = p*r*r + r + 1.f;
+  const std::int32_t bits = ( static_cast<std::int32_t>(n)+127 )<<23;
+  float scale; std::memcpy( &scale,&bits,sizeof(float) );
+  return p*scale;
+};
+
+inline float tanh_poly( float x ) {
+  using namespace vmath;
+  const float ax = ( x<0 ? -x : x );
+  if (ax<tanh_small) {
+    const float z = x*x;
+    float q = tanh_q0;
+    q = q*z + tanh_q1; q = q*z + tanh_q2; q = q*z + tanh_q3; q = q*z + tanh_q4;
+    return q*z*x + x;
+  }
+  const float t = 1.f - 2.f/( exp_poly( 2.f*( ax<tanh_big ? ax : tanh_big ) ) + 1.f );
+  return ( x<0 ? -t : t );
+};
+
+inline float silu_poly( float x ) {
+  return x / ( 1.f+exp_poly( -x ) );
+};
+
+inline float gelu_poly( float x ) {
+  using namespace vmath;
+  const float z = x * ( gelu_a + gelu_b*x*x );
+  return x / ( 1.f+exp_poly( -z ) );
+};
+
+inline float elu_poly( float x ) {
+  return ( x>0 ? x : exp_poly( x )-1.f );
+};
+
+/*
+ * Derivatives: of SiLU and GELU as a function of x,
+ * with s = sigma(z) these are s + x s(1-s) dz/dx;
+ * of ELU as a function of its output a, which is 1 or a+1.
+ */
+inline float silu_grad_poly( float x ) {
+  const float s = 1.f / ( 1.f+exp_poly( -x ) );
+  return s + x * s*( 1.f-s );
+};
+
+inline float gelu_grad_poly( float x ) {
+  using namespace vmath;
+  const float x2 = x*x;
+  const float s = 1.f / ( 1.f+exp_poly( -x*( gelu_a + gelu_b*x2 ) ) );
+  return s + x * s*( 1.f-s ) * ( gelu_a + 3.f*gelu_b*x2 );
+};
+
+inline float elu_grad_poly( float a ) {
+  return ( a>0 ? 1.f : a+1.f );
+};
+
+/*
+ * A cheaper exponential, for inference:
+ * the same range reduction, with e^r a polynomial of degree 2, 3 or 4
+ * instead of 7, minimax for the relative error on |r| <= ln 2 / 2.
+ * Maximum relative error, every float in [exp_lo,exp_hi]:
+ *                with fma (avx2, avx512)   without (sse, scalar)
+ *   degree 2          1.7e-3                     1.7e-3
+ *   degree 3          7.5e-5                     7.5e-5
+ *   degree 4          2.7e-6                     2.7e-6
+ * The sigmoid 1/(1+e^-x) then has an absolute error of at most
+ * a quarter of this, a softmax output a relative error of at most twice this.
+ * Degree 0 stands for the accurate one: exp_approx<0> is exp_poly.
+ */
+namespace vmath {
+  constexpr int exp_approx_lo = 2, exp_approx_hi = 4;
+  // coefficients of r^0, r^1, .., by degree
+  constexpr float exp_approx_c[3][5] = {
+    { 1.0004440212e+00f, 1.0148756599e+00f, 4.9625486040e-01f },
+    { 9.9992793277e-01f, 1.0001645133e+00f, 5.0496818731e-01f, 1.6566742766e-01f },
+    { 9.9999925924e-01f, 9.9996333258e-01f, 5.0004367361e-01f, 1.6791030610e-01f,
+      4.1458400534e-02f } };
+};
+
+template< int D >
+inline float exp_approx( float x ) {
+  if constexpr (D==0)
+    return exp_poly(x);
+  else {
+    using namespace vmath;
+    static_assert( D>=exp_approx_lo and D<=exp_approx_hi );
+    x = ( x>exp_hi ? exp_hi : x );
+    x = ( x<exp_lo ? exp_lo : x );
+    const float magic = 12582912.f;
+    const float n = ( x*log2e + magic ) - magic;
+    const float r = ( x - n*ln2_hi ) - n*ln2_lo;
+    const float *c = exp_approx_c[ D-exp_approx_lo ];
+    float p = c[D];
+    for (int k=D-1; k>=0; k--)
+      p = p*r + c[k];
+    const std::int32_t bits = ( static_cast<std::int32_t>(n)+127 )<<23;
+    float scale; std::memcpy( &scale,&bits,sizeof(float) );
+    return p*scale;
+  }
+};
+
+/*
+ * Which exponential vsigmoid, vexp_sum and the softmax kernels use,
+ * so also the sigmoid activation and the softmax, is their last argument:
+ * 0 (the default) for the accurate one, or a degree above;
+ * any other value is taken as 0.
+ * A net passes its own degree down its forward sweep, see Net::set_approximation.
+ */
+//! the maximum relative error of exp_approx<degree>, from the table above
+float exp_approximation_error( int degree );
+/*!
+ * The cheapest degree for which the sigmoid and softmax outputs
+ * have an absolute error of at most max_error; 0 if none of them do.
+ */
+int  exp_approximation_for( float max_error );
+
+//! op( std::integral_constant<int,D>() ) for the degree D that is the value of d
+template< typename Op >
+inline void with_exp_degree( int d,Op &&op ) {
+  switch (d) {
+  case 2  : op( std::integral_constant<int,2>() ); break;
+  case 3  : op( std::integral_constant<int,3>() ); break;
+  case 4  : op( std::integral_constant<int,4>() ); break;
+  default : op( std::integral_constant<int,0>() );
+  }
+};
+
+/*
+ * Array versions; x and y can be the same.
+ * These are in vmath_impl_simd.cpp, hand-vectorized,
+ * or in vmath_impl_reference.cpp, loops over the scalar functions.
+ */
+// y <- exp( x )
+void  vexp( int n,const float *x,float *y );
+// y <- exp( x-shift ), returning the sum of the y
+float vexp_sum( int n,const float *x,float shift,float *y,int approximation=0 );
+/*
+ * y <- softmax( x ), clamped to [lo,hi], and logy <- x - log sum exp x
+ * unless logy is null; x and y can be the same.
+ * The maximum is subtracted before the exponential.
+ * With AVX2 or AVX-512 this is two sweeps over x: the first finds
+ * the maximum and the sum of the exponentials together, with a running sum
+ * that is rescaled when the maximum grows; the second writes y.
+ * Elsewhere the exponential is too slow to compute twice,
+ * and the exponentials are stored in y between a sweep for the maximum
+ * and one that scales them.
+ */
+void  vsoftmax( int n,const float *x,float *y,float lo,float hi,float *logy,
+		int approximation=0 );
+// y <- 1/( 1+exp(-x) ), clamped to [lo,hi]
+void  vsigmoid( int n,const float *x,float *y,float lo,float hi,int approximation=0 );
+// y <- tanh( x )
+void  vtanh( int n,const float *x,float *y );
+// y <- x sigma( x )
+void  vsilu( int n,const float *x,float *y );
+// y <- gelu( x ), tanh form
+void  vgelu( int n,const float *x,float *y );
+// y <- elu( x ), alpha=1
+void  velu( int n,const float *x,float *y );
+// g <- the derivatives above; elu from its output
+void  vsilu_grad( int n,const float *x,float *g );
+void  vgelu_grad( int n,const float *x,float *g );
+void  velu_grad( int n,const float *a,float *g );
+
+#endif //SRC_VMATH_H
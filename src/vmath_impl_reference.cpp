@@ -0,0 +1,105 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "vmath.h"
+
+#include <algorithm>
+#include <cmath>
+
+void vexp( int n,const float *x,float *y ) {
+  for (int i=0; i<n; i++)
+    y[i] = exp_poly( x[i] );
+}
+
+float vexp_sum( int n,const float *x,float shift,float *y,int approximation ) {
+  float s{0.f};
+  with_exp_degree
+    ( approximation,[&] ( auto d ) {
+      constexpr int D = decltype(d)::value;
+      for (int i=0; i<n; i++) {
+	y[i] = exp_approx<D>( x[i]-shift );
+	s += y[i];
+      }
+    } );
+  return s;
+}
+
+void vsoftmax( int n,const float *x,float *y,float lo,float hi,float *logy,
+	       int approximation ) {
+  const float xmax = *std::max_element( x,x+n );
+  float sum;
+  if (logy==nullptr)
+    sum = vexp_sum( n,x,xmax,y,approximation );
+  else {
+    // through logy, so that this also works in place
+    for (int i=0; i<n; i++)
+      logy[i] = x[i] - xmax;
+    sum = vexp_sum( n,logy,0.f,y,approximation );
+    const float logsum = std::log(sum);
+    for (int i=0; i<n; i++)
+      logy[i] -= logsum;
+  }
+  const float scale = 1.f/sum;
+  for (int i=0; i<n; i++) {
+    float e = y[i]*scale;
+    e = ( e<lo ? lo : e );
+    y[i] = ( e>hi ? hi : e );
+  }
+}
+
+void vsigmoid( int n,const float *x,float *y,float lo,float hi,int approximation ) {
+  with_exp_degree
+    ( approximation,[&] ( auto d ) {
+      constexpr int D = decltype(d)::value;
+      for (int i=0; i<n; i++) {
+	float e = 1.f/( 1.f+exp_approx<D>( -x[i] ) );
+	e = ( e<lo ? lo : e );
+	y[i] = ( e>hi ? hi : e );
+      }
+    } );
+}
+
+void vtanh( int n,const float *x,float *y ) {
+  for (int i=0; i<n; i++)
+    y[i] = tanh_poly( x[i] );
+}
+
+void vsilu( int n,const float *x,float *y ) {
+  for (int i=0; i<n; i++)
+    y[i] = silu_poly( x[i] );
+}
+
+void vgelu( int n,const float *x,float *y ) {
+  for (int i=0; i<n; i++)
+    y[i] = gelu_poly( x[i] );
+}
+
+void velu( int n,const float *x,float *y ) {
+  for (int i=0; i<n; i++)
+    y[i] = elu_poly( x[i] );
+}
+
+void vsilu_grad( int n,const float *x,float *g ) {
+  for (int i=0; i<n; i++)
+    g[i] = silu_grad_poly( x[i] );
+}
+
+void vgelu_grad( int n,const float *x,float *g ) {
+  for (int i=0; i<n; i++)
+    g[i] = gelu_grad_poly( x[i] );
+}
+
+void velu_grad( int n,const float *a,float *g ) {
+  for (int i=0; i<n; i++)
+    g[i] = elu_grad_poly( a[i] );
+}
@@ -0,0 +1,787 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#include "vmath.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#define TARGET_AVX2   __attribute__((target("avx2,fma")))
+#endif
+
+using namespace vmath;
+
+/*
+ * The same polynomials as the scalar functions in vmath.h,
+ * one register at a time; see there for the error bounds.
+ * Clamping puts x second in min/max, so that a NaN comes through.
+ * Remainders are done as a whole register,
+ * masked for AVX-512, through a small buffer otherwise,
+ * so that every element gets the same arithmetic.
+ * The functions of one argument share a loop, map_<isa>,
+ * which is instantiated with the register function.
+ */
+
+#ifdef SIMD_X86
+
+/*
+ * AVX-512
+ */
+template< int D=0 >
+TARGET_AVX512 static __m512 exp_avx512( __m512 x ) {
+  x = _mm512_min_ps( _mm512_set1_ps(exp_hi),x );
+  x = _mm512_max_ps( _mm512_set1_ps(exp_lo),x );
+  const __m512 n = _mm512_roundscale_ps
+    ( _mm512_mul_ps( x,_mm512_set1_ps(log2e) ),_MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC );
+  __m512 r = _mm512_fnmadd_ps( n,_mm512_set1_ps(ln2_hi),x );
+  r = _mm512_fnmadd_ps( n,_mm512_set1_ps(ln2_lo),r );
+  __m512 p;
+  if constexpr (D==0) {
+    p = _mm512_set1_ps(exp_p0);
+    p = _mm512_fmadd_ps( p,r,_mm512_set1_ps(exp_p1) );
+    p = _mm512_fmadd_ps( p,r,_mm512_set1_ps(exp_p2) );
+    p = _mm512_fmadd_ps( p,r,_mm512_set1_ps(exp_p3) );
+    p = _mm512_fmadd_ps( p,r,_mm512_set1_ps(exp_p4) );
+    p = _mm512_fmadd_ps( p,r,_mm512_set1_ps(exp_p5) );
+    p = _mm512_fmadd_ps( _mm512_mul_ps(p,r),r,_mm512_add_ps( r,_mm512_set1_ps(1.f) ) );
+  } else {
+    const float *c = exp_approx_c[ D-exp_approx_lo ];
+    p = _mm512_set1_ps(c[D]);
+    for (int k=D-1; k>=0; k--)
+      p = _mm512_fmadd_ps( p,r,_mm512_set1_ps(c[k]) );
+  }
+  const __m512i bits = _mm512_slli_epi32
+    ( _mm512_add_epi32( _mm512_cvtps_epi32(n),_mm512_set1_epi32(127) ),23 );
+  return _mm512_mul_ps( p,_mm512_castsi512_ps(bits) );
+}
+template< int D >
+TARGET_AVX512 static __m512 sigmoid_avx512( __m512 x,__m512 lo,__m512 hi ) {
+  const __m512 one = _mm512_set1_ps(1.f);
+  const __m512 s = _mm512_div_ps
+    ( one,_mm512_add_ps( one,exp_avx512<D>( _mm512_sub_ps( _mm512_setzero_ps(),x ) ) ) );
+  return _mm512_min_ps( hi,_mm512_max_ps( lo,s ) );
+}
+TARGET_AVX512 static __m512 tanh_avx512( __m512 x ) {
+  const __m512 ax = _mm512_abs_ps(x);
+  const __m512 z = _mm512_mul_ps(x,x);
+  __m512 q = _mm512_set1_ps(tanh_q0);
+  q = _mm512_fmadd_ps( q,z,_mm512_set1_ps(tanh_q1) );
+  q = _mm512_fmadd_ps( q,z,_mm512_set1_ps(tanh_q2) );
+  q = _mm512_fmadd_ps( q,z,_mm512_set1_ps(tanh_q3) );
+  q = _mm512_fmadd_ps( q,z,_mm512_set1_ps(tanh_q4) );
+  const __m512 small = _mm512_fmadd_ps( _mm512_mul_ps(q,z),x,x );
+  const __m512 one = _mm512_set1_ps(1.f);
+  const __m512 a = _mm512_min_ps(ax,_mm512_set1_ps(tanh_big));
+  const __m512 e = exp_avx512( _mm512_add_ps(a,a) );
+  __m512 big = _mm512_sub_ps
+    ( one,_mm512_div_ps( _mm512_set1_ps(2.f),_mm512_add_ps(e,one) ) );
+  // copy the sign of x
+  big = _mm512_castsi512_ps
+    ( _mm512_or_si512( _mm512_castps_si512(big),
+		       _mm512_and_si512( _mm512_castps_si512(x),_mm512_set1_epi32(0x80000000) ) ) );
+  const __mmask16 is_small = _mm512_cmp_ps_mask( ax,_mm512_set1_ps(tanh_small),_CMP_LT_OQ );
+  return _mm512_mask_blend_ps( is_small,big,small );
+}
+
+// x / ( 1+e^-z ): silu with z=x, gelu with z a cubic in x
+TARGET_AVX512 static __m512 x_sigmoid_avx512( __m512 x,__m512 z ) {
+  return _mm512_div_ps
+    ( x,_mm512_add_ps( _mm512_set1_ps(1.f),exp_avx512( _mm512_sub_ps( _mm512_setzero_ps(),z ) ) ) );
+}
+TARGET_AVX512 static __m512 silu_avx512( __m512 x ) {
+  return x_sigmoid_avx512( x,x );
+}
+TARGET_AVX512 static __m512 gelu_avx512( __m512 x ) {
+  const __m512 u = _mm512_fmadd_ps
+    ( _mm512_mul_ps(x,x),_mm512_set1_ps(gelu_b),_mm512_set1_ps(gelu_a) );
+  return x_sigmoid_avx512( x,_mm512_mul_ps(x,u) );
+}
+TARGET_AVX512 static __m512 elu_avx512( __m512 x ) {
+  const __m512 e = _mm512_sub_ps
+    ( exp_avx512( _mm512_min_ps( _mm512_setzero_ps(),x ) ),_mm512_set1_ps(1.f) );
+  const __mmask16 pos = _mm512_cmp_ps_mask( x,_mm512_setzero_ps(),_CMP_GT_OQ );
+  return _mm512_mask_blend_ps( pos,e,x );
+}
+
+// s + x s(1-s) dz, with s = sigma(z)
+TARGET_AVX512 static __m512 x_sigmoid_grad_avx512( __m512 x,__m512 z,__m512 dz ) {
+  const __m512 one = _mm512_set1_ps(1.f);
+  const __m512 s = _mm512_div_ps
+    ( one,_mm512_add_ps( one,exp_avx512( _mm512_sub_ps( _mm512_setzero_ps(),z ) ) ) );
+  const __m512 ds = _mm512_mul_ps( _mm512_mul_ps( s,_mm512_sub_ps(one,s) ),dz );
+  return _mm512_fmadd_ps( x,ds,s );
+}
+TARGET_AVX512 static __m512 silu_grad_avx512( __m512 x ) {
+  return x_sigmoid_grad_avx512( x,x,_mm512_set1_ps(1.f) );
+}
+TARGET_AVX512 static __m512 gelu_grad_avx512( __m512 x ) {
+  const __m512 x2 = _mm512_mul_ps(x,x), a = _mm512_set1_ps(gelu_a);
+  const __m512 u = _mm512_fmadd_ps( x2,_mm512_set1_ps(gelu_b),a );
+  const __m512 du = _mm512_fmadd_ps( x2,_mm512_set1_ps(3.f*gelu_b),a );
+  return x_sigmoid_grad_avx512( x,_mm512_mul_ps(x,u),du );
+}
+TARGET_AVX512 static __m512 elu_grad_avx512( __m512 a ) {
+  return _mm512_add_ps( _mm512_min_ps( _mm512_setzero_ps(),a ),_mm512_set1_ps(1.f) );
+}
+
+template< __m512 (*F)(__m512) >
+TARGET_AVX512 static void map_avx512( int n,const float *x,float *y ) {
+  for (int i=0; i<n; i+=16) {
+    const __mmask16 m = ( n-i>=16 ? 0xFFFF : (1U<<(n-i))-1 );
+    _mm512_mask_storeu_ps( y+i,m, F( _mm512_maskz_loadu_ps(m,x+i) ) );
+  }
+}
+template< int D >
+TARGET_AVX512 static float vexp_sum_avx512( int n,const float *x,float shift,float *y ) {
+  const __m512 vshift = _mm512_set1_ps(shift);
+  __m512 s = _mm512_setzero_ps();
+  for (int i=0; i<n; i+=16) {
+    const __mmask16 m = ( n-i>=16 ? 0xFFFF : (1U<<(n-i))-1 );
+    const __m512 e = exp_avx512<D>( _mm512_sub_ps( _mm512_maskz_loadu_ps(m,x+i),vshift ) );
+    _mm512_mask_storeu_ps( y+i,m,e );
+    s = _mm512_mask_add_ps( s,m,s,e );
+  }
+  return _mm512_reduce_add_ps(s);
+}
+template< int D >
+TARGET_AVX512 static void vsigmoid_avx512( int n,const float *x,float *y,float lo,float hi ) {
+  const __m512 vlo = _mm512_set1_ps(lo), vhi = _mm512_set1_ps(hi);
+  for (int i=0; i<n; i+=16) {
+    const __mmask16 m = ( n-i>=16 ? 0xFFFF : (1U<<(n-i))-1 );
+    _mm512_mask_storeu_ps( y+i,m, sigmoid_avx512<D>( _mm512_maskz_loadu_ps(m,x+i),vlo,vhi ) );
+  }
+}
+
+/*
+ * Online softmax: per lane a running maximum, and the sum of the exponentials
+ * relative to it, which is rescaled when the maximum grows.
+ * By blocks of four registers, so that there is one rescaling per four exponentials.
+ * The maximum starts at the lowest float rather than -inf,
+ * so that a lane without elements does not give inf-inf.
+ * The rescaling always takes the accurate exponential:
+ * an approximate one is not 1 at 0, and its error would pile up over the blocks.
+ */
+template< int D >
+TARGET_AVX512 static void vmax_expsum_avx512( int n,const float *x,float *max,float *sum ) {
+  __m512 m = _mm512_set1_ps( -std::numeric_limits<float>::max() ), s = _mm512_setzero_ps();
+  int i=0;
+  for ( ; i+64<=n; i+=64) {
+    const __m512 x0 = _mm512_loadu_ps(x+i),    x1 = _mm512_loadu_ps(x+i+16),
+                 x2 = _mm512_loadu_ps(x+i+32), x3 = _mm512_loadu_ps(x+i+48);
+    const __m512 mnew = _mm512_max_ps
+      ( m,_mm512_max_ps( _mm512_max_ps(x0,x1),_mm512_max_ps(x2,x3) ) );
+    s = _mm512_mul_ps( s,exp_avx512( _mm512_sub_ps(m,mnew) ) );
+    s = _mm512_add_ps
+      ( s,_mm512_add_ps
+	( _mm512_add_ps( exp_avx512<D>( _mm512_sub_ps(x0,mnew) ),exp_avx512<D>( _mm512_sub_ps(x1,mnew) ) ),
+	  _mm512_add_ps( exp_avx512<D>( _mm512_sub_ps(x2,mnew) ),exp_avx512<D>( _mm512_sub_ps(x3,mnew) ) ) ) );
+    m = mnew;
+  }
+  for ( ; i<n; i+=16) {
+    const __mmask16 k = ( n-i>=16 ? 0xFFFF : (1U<<(n-i))-1 );
+    const __m512 xi = _mm512_maskz_loadu_ps(k,x+i);
+    const __m512 mnew = _mm512_mask_max_ps( m,k,m,xi );
+    s = _mm512_mul_ps( s,exp_avx512( _mm512_sub_ps(m,mnew) ) );
+    s = _mm512_mask_add_ps( s,k,s,exp_avx512<D>( _mm512_sub_ps(xi,mnew) ) );
+    m = mnew;
+  }
+  const float mx = _mm512_reduce_max_ps(m);
+  *max = mx;
+  *sum = _mm512_reduce_add_ps
+    ( _mm512_mul_ps( s,exp_avx512( _mm512_sub_ps( m,_mm512_set1_ps(mx) ) ) ) );
+}
+template< int D >
+TARGET_AVX512 static void vsoftmax_normalize_avx512
+    ( int n,const float *x,float max,float scale,float logsum,float lo,float hi,float *y,float *logy ) {
+  const __m512 vmax = _mm512_set1_ps(max), vscale = _mm512_set1_ps(scale),
+    vlogsum = _mm512_set1_ps(logsum), vlo = _mm512_set1_ps(lo), vhi = _mm512_set1_ps(hi);
+  for (int i=0; i<n; i+=16) {
+    const __mmask16 k = ( n-i>=16 ? 0xFFFF : (1U<<(n-i))-1 );
+    const __m512 xi = _mm512_sub_ps( _mm512_maskz_loadu_ps(k,x+i),vmax );
+    if (logy!=nullptr)
+      _mm512_mask_storeu_ps( logy+i,k,_mm512_sub_ps(xi,vlogsum) );
+    const __m512 e = _mm512_mul_ps( exp_avx512<D>(xi),vscale );
+    _mm512_mask_storeu_ps( y+i,k,_mm512_min_ps( vhi,_mm512_max_ps(vlo,e) ) );
+  }
+}
+
+/*
+ * AVX2
+ */
+template< int D=0 >
+TARGET_AVX2 static __m256 exp_avx2( __m256 x ) {
+  x = _mm256_min_ps( _mm256_set1_ps(exp_hi),x );
+  x = _mm256_max_ps( _mm256_set1_ps(exp_lo),x );
+  const __m256 n = _mm256_round_ps
+    ( _mm256_mul_ps( x,_mm256_set1_ps(log2e) ),_MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC );
+  __m256 r = _mm256_fnmadd_ps( n,_mm256_set1_ps(ln2_hi),x );
+  r = _mm256_fnmadd_ps( n,_mm256_set1_ps(ln2_lo),r );
+  __m256 p;
+  if constexpr (D==0) {
+    p = _mm256_set1_ps(exp_p0);
+    p = _mm256_fmadd_ps( p,r,_mm256_set1_ps(exp_p1) );
+    p = _mm256_fmadd_ps( p,r,_mm256_set1_ps(exp_p2) );
+    p = _mm256_fmadd_ps( p,r,_mm256_set1_ps(exp_p3) );
+    p = _mm256_fmadd_ps( p,r,_mm256_set1_ps(exp_p4) );
+    p = _mm256_fmadd_ps( p,r,_mm256_set1_ps(exp_p5) );
+    p = _mm256_fmadd_ps( _mm256_mul_ps(p,r),r,_mm256_add_ps( r,_mm256_set1_ps(1.f) ) );
+  } else {
+    const float *c = exp_approx_c[ D-exp_approx_lo ];
+    p = _mm256_set1_ps(c[D]);
+    for (int k=D-1; k>=0; k--)
+      p = _mm256_fmadd_ps( p,r,_mm256_set1_ps(c[k]) );
+  }
+  const __m256i bits = _mm256_slli_epi32
+    ( _mm256_add_epi32( _mm256_cvtps_epi32(n),_mm256_set1_epi32(127) ),23 );
+  return _mm256_mul_ps( p,_mm256_castsi256_ps(bits) );
+}
+template< int D >
+TARGET_AVX2 static __m256 sigmoid_avx2( __m256 x,__m256 lo,__m256 hi ) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 s = _mm256_div_ps
+    ( one,_mm256_add_ps( one,exp_avx2<D>( _mm256_sub_ps( _mm256_setzero_ps(),x ) ) ) );
+  return _mm256_min_ps( hi,_mm256_max_ps( lo,s ) );
+}
+TARGET_AVX2 static __m256 tanh_avx2( __m256 x ) {
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  const __m256 ax = _mm256_andnot_ps(sign,x);
+  const __m256 z = _mm256_mul_ps(x,x);
+  __m256 q = _mm256_set1_ps(tanh_q0);
+  q = _mm256_fmadd_ps( q,z,_mm256_set1_ps(tanh_q1) );
+  q = _mm256_fmadd_ps( q,z,_mm256_set1_ps(tanh_q2) );
+  q = _mm256_fmadd_ps( q,z,_mm256_set1_ps(tanh_q3) );
+  q = _mm256_fmadd_ps( q,z,_mm256_set1_ps(tanh_q4) );
+  const __m256 small = _mm256_fmadd_ps( _mm256_mul_ps(q,z),x,x );
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 a = _mm256_min_ps(ax,_mm256_set1_ps(tanh_big));
+  const __m256 e = exp_avx2( _mm256_add_ps(a,a) );
+  __m256 big = _mm256_sub_ps
+    ( one,_mm256_div_ps( _mm256_set1_ps(2.f),_mm256_add_ps(e,one) ) );
+  big = _mm256_or_ps( big,_mm256_and_ps(sign,x) );
+  return _mm256_blendv_ps
+    ( big,small,_mm256_cmp_ps( ax,_mm256_set1_ps(tanh_small),_CMP_LT_OQ ) );
+}
+
+TARGET_AVX2 static __m256 x_sigmoid_avx2( __m256 x,__m256 z ) {
+  return _mm256_div_ps
+    ( x,_mm256_add_ps( _mm256_set1_ps(1.f),exp_avx2( _mm256_sub_ps( _mm256_setzero_ps(),z ) ) ) );
+}
+TARGET_AVX2 static __m256 silu_avx2( __m256 x ) {
+  return x_sigmoid_avx2( x,x );
+}
+TARGET_AVX2 static __m256 gelu_avx2( __m256 x ) {
+  const __m256 u = _mm256_fmadd_ps
+    ( _mm256_mul_ps(x,x),_mm256_set1_ps(gelu_b),_mm256_set1_ps(gelu_a) );
+  return x_sigmoid_avx2( x,_mm256_mul_ps(x,u) );
+}
+TARGET_AVX2 static __m256 elu_avx2( __m256 x ) {
+  const __m256 e = _mm256_sub_ps
+    ( exp_avx2( _mm256_min_ps( _mm256_setzero_ps(),x ) ),_mm256_set1_ps(1.f) );
+  return _mm256_blendv_ps
+    ( e,x,_mm256_cmp_ps( x,_mm256_setzero_ps(),_CMP_GT_OQ ) );
+}
+
+TARGET_AVX2 static __m256 x_sigmoid_grad_avx2( __m256 x,__m256 z,__m256 dz ) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 s = _mm256_div_ps
+    ( one,_mm256_add_ps( one,exp_avx2( _mm256_sub_ps( _mm256_setzero_ps(),z ) ) ) );
+  const __m256 ds = _mm256_mul_ps( _mm256_mul_ps( s,_mm256_sub_ps(one,s) ),dz );
+  return _mm256_fmadd_ps( x,ds,s );
+}
+TARGET_AVX2 static __m256 silu_grad_avx2( __m256 x ) {
+  return x_sigmoid_grad_avx2( x,x,_mm256_set1_ps(1.f) );
+}
+TARGET_AVX2 static __m256 gelu_grad_avx2( __m256 x ) {
+  const __m256 x2 = _mm256_mul_ps(x,x), a = _mm256_set1_ps(gelu_a);
+  const __m256 u = _mm256_fmadd_ps( x2,_mm256_set1_ps(gelu_b),a );
+  const __m256 du = _mm256_fmadd_ps( x2,_mm256_set1_ps(3.f*gelu_b),a );
+  return x_sigmoid_grad_avx2( x,_mm256_mul_ps(x,u),du );
+}
+TARGET_AVX2 static __m256 elu_grad_avx2( __m256 a ) {
+  return _mm256_add_ps( _mm256_min_ps( _mm256_setzero_ps(),a ),_mm256_set1_ps(1.f) );
+}
+
+template< __m256 (*F)(__m256) >
+TARGET_AVX2 static void map_avx2( int n,const float *x,float *y ) {
+  int i=0;
+  for ( ; i+8<=n; i+=8)
+    _mm256_storeu_ps( y+i, F( _mm256_loadu_ps(x+i) ) );
+  if (i<n) {
+    float buf[8]{};
+    std::memcpy( buf,x+i,(n-i)*sizeof(float) );
+    _mm256_storeu_ps( buf, F( _mm256_loadu_ps(buf) ) );
+    std::memcpy( y+i,buf,(n-i)*sizeof(float) );
+  }
+}
+template< int D >
+TARGET_AVX2 static float vexp_sum_avx2( int n,const float *x,float shift,float *y ) {
+  const __m256 vshift = _mm256_set1_ps(shift);
+  __m256 s = _mm256_setzero_ps();
+  int i=0;
+  for ( ; i+8<=n; i+=8) {
+    const __m256 e = exp_avx2<D>( _mm256_sub_ps( _mm256_loadu_ps(x+i),vshift ) );
+    _mm256_storeu_ps( y+i,e );
+    s = _mm256_add_ps( s,e );
+  }
+  float sum{0.f};
+  if (i<n) {
+    float buf[8]{};
+    std::memcpy( buf,x+i,(n-i)*sizeof(float) );
+    _mm256_storeu_ps( buf, exp_avx2<D>( _mm256_sub_ps( _mm256_loadu_ps(buf),vshift ) ) );
+    std::memcpy( y+i,buf,(n-i)*sizeof(float) );
+    for (int k=0; k<n-i; k++)
+      sum += buf[k];
+  }
+  __m128 h = _mm_add_ps( _mm256_castps256_ps128(s),_mm256_extractf128_ps(s,1) );
+  h = _mm_add_ps( h,_mm_movehl_ps(h,h) );
+  h = _mm_add_ss( h,_mm_shuffle_ps(h,h,1) );
+  return sum + _mm_cvtss_f32(h);
+}
+template< int D >
+TARGET_AVX2 static void vsigmoid_avx2( int n,const float *x,float *y,float lo,float hi ) {
+  const __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+  int i=0;
+  for ( ; i+8<=n; i+=8)
+    _mm256_storeu_ps( y+i, sigmoid_avx2<D>( _mm256_loadu_ps(x+i),vlo,vhi ) );
+  if (i<n) {
+    float buf[8]{};
+    std::memcpy( buf,x+i,(n-i)*sizeof(float) );
+    _mm256_storeu_ps( buf, sigmoid_avx2<D>( _mm256_loadu_ps(buf),vlo,vhi ) );
+    std::memcpy( y+i,buf,(n-i)*sizeof(float) );
+  }
+}
+
+// see vmax_expsum_avx512; the remainder is padded with the lowest float,
+// whose exponential, 1e-38, does not change a sum that is at least one
+TARGET_AVX2 static float hmax_avx2( __m256 v ) {
+  __m128 h = _mm_max_ps( _mm256_castps256_ps128(v),_mm256_extractf128_ps(v,1) );
+  h = _mm_max_ps( h,_mm_movehl_ps(h,h) );
+  h = _mm_max_ss( h,_mm_shuffle_ps(h,h,1) );
+  return _mm_cvtss_f32(h);
+}
+TARGET_AVX2 static float hsum_avx2( __m256 v ) {
+  __m128 h = _mm_add_ps( _mm256_castps256_ps128(v),_mm256_extractf128_ps(v,1) );
+  h = _mm_add_ps( h,_mm_movehl_ps(h,h) );
+  h = _mm_add_ss( h,_mm_shuffle_ps(h,h,1) );
+  return _mm_cvtss_f32(h);
+}
+template< int D >
+TARGET_AVX2 static void vmax_expsum_avx2( int n,const float *x,float *max,float *sum ) {
+  const float lowest = -std::numeric_limits<float>::max();
+  __m256 m = _mm256_set1_ps(lowest), s = _mm256_setzero_ps();
+  int i=0;
+  for ( ; i+32<=n; i+=32) {
+    const __m256 x0 = _mm256_loadu_ps(x+i),    x1 = _mm256_loadu_ps(x+i+8),
+                 x2 = _mm256_loadu_ps(x+i+16), x3 = _mm256_loadu_ps(x+i+24);
+    const __m256 mnew = _mm256_max_ps
+      ( m,_mm256_max_ps( _mm256_max_ps(x0,x1),_mm256_max_ps(x2,x3) ) );
+    s = _mm256_mul_ps( s,exp_avx2( _mm256_sub_ps(m,mnew) ) );
+    s = _mm256_add_ps
+      ( s,_mm256_add_ps
+	( _mm256_add_ps( exp_avx2<D>( _mm256_sub_ps(x0,mnew) ),exp_avx2<D>( _mm256_sub_ps(x1,mnew) ) ),
+	  _mm256_add_ps( exp_avx2<D>( _mm256_sub_ps(x2,mnew) ),exp_avx2<D>( _mm256_sub_ps(x3,mnew) ) ) ) );
+    m = mnew;
+  }
+  for ( ; i<n; i+=8) {
+    float buf[8] = { lowest,lowest,lowest,lowest,lowest,lowest,lowest,lowest };
+    std::memcpy( buf,x+i,std::min(8,n-i)*sizeof(float) );
+    const __m256 xi = _mm256_loadu_ps(buf);
+    const __m256 mnew = _mm256_max_ps(m,xi);
+    s = _mm256_mul_ps( s,exp_avx2( _mm256_sub_ps(m,mnew) ) );
+    s = _mm256_add_ps( s,exp_avx2<D>( _mm256_sub_ps(xi,mnew) ) );
+    m = mnew;
+  }
+  const float mx = hmax_avx2(m);
+  *max = mx;
+  *sum = hsum_avx2( _mm256_mul_ps( s,exp_avx2( _mm256_sub_ps( m,_mm256_set1_ps(mx) ) ) ) );
+}
+template< int D >
+TARGET_AVX2 static __m256 softmax_normalize_avx2
+    ( __m256 x,__m256 max,__m256 scale,__m256 lo,__m256 hi ) {
+  const __m256 e = _mm256_mul_ps( exp_avx2<D>( _mm256_sub_ps(x,max) ),scale );
+  return _mm256_min_ps( hi,_mm256_max_ps(lo,e) );
+}
+template< int D >
+TARGET_AVX2 static void vsoftmax_normalize_avx2
+    ( int n,const float *x,float max,float scale,float logsum,float lo,float hi,float *y,float *logy ) {
+  const __m256 vmax = _mm256_set1_ps(max), vscale = _mm256_set1_ps(scale),
+    vlogsum = _mm256_set1_ps(logsum), vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+  int i=0;
+  for ( ; i+8<=n; i+=8) {
+    const __m256 xi = _mm256_loadu_ps(x+i);
+    if (logy!=nullptr)
+      _mm256_storeu_ps( logy+i,_mm256_sub_ps( _mm256_sub_ps(xi,vmax),vlogsum ) );
+    _mm256_storeu_ps( y+i,softmax_normalize_avx2<D>( xi,vmax,vscale,vlo,vhi ) );
+  }
+  if (i<n) {
+    float buf[8]{};
+    std::memcpy( buf,x+i,(n-i)*sizeof(float) );
+    const __m256 xi = _mm256_loadu_ps(buf);
+    if (logy!=nullptr) {
+      _mm256_storeu_ps( buf,_mm256_sub_ps( _mm256_sub_ps(xi,vmax),vlogsum ) );
+      std::memcpy( logy+i,buf,(n-i)*sizeof(float) );
+    }
+    _mm256_storeu_ps( buf,softmax_normalize_avx2<D>( xi,vmax,vscale,vlo,vhi ) );
+    std::memcpy( y+i,buf,(n-i)*sizeof(float) );
+  }
+}
+
+/*
+ * SSE2: no fma, no rounding instruction;
+ * the conversion to integer rounds to nearest
+ */
+template< int D=0 >
+static __m128 exp_sse( __m128 x ) {
+  x = _mm_min_ps( _mm_set1_ps(exp_hi),x );
+  x = _mm_max_ps( _mm_set1_ps(exp_lo),x );
+  const __m128i ni = _mm_cvtps_epi32( _mm_mul_ps( x,_mm_set1_ps(log2e) ) );
+  const __m128 n = _mm_cvtepi32_ps(ni);
+  __m128 r = _mm_sub_ps( x,_mm_mul_ps( n,_mm_set1_ps(ln2_hi) ) );
+  r = _mm_sub_ps( r,_mm_mul_ps( n,_mm_set1_ps(ln2_lo) ) );
+  __m128 p;
+  if constexpr (D==0) {
+    p = _mm_set1_ps(exp_p0);
+    p = _mm_add_ps( _mm_mul_ps(p,r),_mm_set1_ps(exp_p1) );
+    p = _mm_add_ps( _mm_mul_ps(p,r),_mm_set1_ps(exp_p2) );
+    p = _mm_add_ps( _mm_mul_ps(p,r),_mm_set1_ps(exp_p3) );
+    p = _mm_add_ps( _mm_mul_ps(p,r),_mm_set1_ps(exp_p4) );
+    p = _mm_add_ps( _mm_mul_ps(p,r),_mm_set1_ps(exp_p5) );
+    p = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_mul_ps(p,r),r ),r ),_mm_set1_ps(1.f) );
+  } else {
+    const float *c = exp_approx_c[ D-exp_approx_lo ];
+    p = _mm_set1_ps(c[D]);
+    for (int k=D-1; k>=0; k--)
+      p = _mm_add_ps( _mm_mul_ps(p,r),_mm_set1_ps(c[k]) );
+  }
+  const __m128i bits = _mm_slli_epi32( _mm_add_epi32( ni,_mm_set1_epi32(127) ),23 );
+  return _mm_mul_ps( p,_mm_castsi128_ps(bits) );
+}
+template< int D >
+static __m128 sigmoid_sse( __m128 x,__m128 lo,__m128 hi ) {
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 s = _mm_div_ps
+    ( one,_mm_add_ps( one,exp_sse<D>( _mm_sub_ps( _mm_setzero_ps(),x ) ) ) );
+  return _mm_min_ps( hi,_mm_max_ps( lo,s ) );
+}
+static __m128 tanh_sse( __m128 x ) {
+  const __m128 sign = _mm_set1_ps(-0.f);
+  const __m128 ax = _mm_andnot_ps(sign,x);
+  const __m128 z = _mm_mul_ps(x,x);
+  __m128 q = _mm_set1_ps(tanh_q0);
+  q = _mm_add_ps( _mm_mul_ps(q,z),_mm_set1_ps(tanh_q1) );
+  q = _mm_add_ps( _mm_mul_ps(q,z),_mm_set1_ps(tanh_q2) );
+  q = _mm_add_ps( _mm_mul_ps(q,z),_mm_set1_ps(tanh_q3) );
+  q = _mm_add_ps( _mm_mul_ps(q,z),_mm_set1_ps(tanh_q4) );
+  const __m128 small = _mm_add_ps( _mm_mul_ps( _mm_mul_ps(q,z),x ),x );
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 a = _mm_min_ps(ax,_mm_set1_ps(tanh_big));
+  const __m128 e = exp_sse( _mm_add_ps(a,a) );
+  __m128 big = _mm_sub_ps( one,_mm_div_ps( _mm_set1_ps(2.f),_mm_add_ps(e,one) ) );
+  big = _mm_or_ps( big,_mm_and_ps(sign,x) );
+  const __m128 is_small = _mm_cmplt_ps( ax,_mm_set1_ps(tanh_small) );
+  return _mm_or_ps( _mm_and_ps(is_small,small),_mm_andnot_ps(is_small,big) );
+}
+
+static __m128 x_sigmoid_sse( __m128 x,__m128 z ) {
+  return _mm_div_ps
+    ( x,_mm_add_ps( _mm_set1_ps(1.f),exp_sse( _mm_sub_ps( _mm_setzero_ps(),z ) ) ) );
+}
+static __m128 silu_sse( __m128 x ) {
+  return x_sigmoid_sse( x,x );
+}
+static __m128 gelu_sse( __m128 x ) {
+  const __m128 u = _mm_add_ps
+    ( _mm_mul_ps( _mm_mul_ps(x,x),_mm_set1_ps(gelu_b) ),_mm_set1_ps(gelu_a) );
+  return x_sigmoid_sse( x,_mm_mul_ps(x,u) );
+}
+static __m128 elu_sse( __m128 x ) {
+  const __m128 e = _mm_sub_ps
+    ( exp_sse( _mm_min_ps( _mm_setzero_ps(),x ) ),_mm_set1_ps(1.f) );
+  const __m128 pos = _mm_cmpgt_ps( x,_mm_setzero_ps() );
+  return _mm_or_ps( _mm_and_ps(pos,x),_mm_andnot_ps(pos,e) );
+}
+
+static __m128 x_sigmoid_grad_sse( __m128 x,__m128 z,__m128 dz ) {
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 s = _mm_div_ps
+    ( one,_mm_add_ps( one,exp_sse( _mm_sub_ps( _mm_setzero_ps(),z ) ) ) );
+  const __m128 ds = _mm_mul_ps( _mm_mul_ps( s,_mm_sub_ps(one,s) ),dz );
+  return _mm_add_ps( _mm_mul_ps(x,ds),s );
+}
+static __m128 silu_grad_sse( __m128 x ) {
+  return x_sigmoid_grad_sse( x,x,_mm_set1_ps(1.f) );
+}
+static __m128 gelu_grad_sse( __m128 x ) {
+  const __m128 x2 = _mm_mul_ps(x,x), a = _mm_set1_ps(gelu_a);
+  const __m128 u = _mm_add_ps( _mm_mul_ps( x2,_mm_set1_ps(gelu_b) ),a );
+  const __m128 du = _mm_add_ps( _mm_mul_ps( x2,_mm_set1_ps(3.f*gelu_b) ),a );
+  return x_sigmoid_grad_sse( x,_mm_mul_ps(x,u),du );
+}
+static __m128 elu_grad_sse( __m128 a ) {
+  return _mm_add_ps( _mm_min_ps( _mm_setzero_ps(),a ),_mm_set1_ps(1.f) );
+}
+
+template< __m128 (*F)(__m128) >
+static void map_sse( int n,const float *x,float *y ) {
+  int i=0;
+  for ( ; i+4<=n; i+=4)
+    _mm_storeu_ps( y+i, F( _mm_loadu_ps(x+i) ) );
+  if (i<n) {
+    float buf[4]{};
+    std::memcpy( buf,x+i,(n-i)*sizeof(float) );
+    _mm_storeu_ps( buf, F( _mm_loadu_ps(buf) ) );
+    std::memcpy( y+i,buf,(n-i)*sizeof(float) );
+  }
+}
+template< int D >
+static float vexp_sum_sse( int n,const float *x,float shift,float *y ) {
+  const __m128 vshift = _mm_set1_ps(shift);
+  __m128 s = _mm_setzero_ps();
+  int i=0;
+  for ( ; i+4<=n; i+=4) {
+    const __m128 e = exp_sse<D>( _mm_sub_ps( _mm_loadu_ps(x+i),vshift ) );
+    _mm_storeu_ps( y+i,e );
+    s = _mm_add_ps( s,e );
+  }
+  float sum{0.f};
+  if (i<n) {
+    float buf[4]{};
+    std::memcpy( buf,x+i,(n-i)*sizeof(float) );
+    _mm_storeu_ps( buf, exp_sse<D>( _mm_sub_ps( _mm_loadu_ps(buf),vshift ) ) );
+    std::memcpy( y+i,buf,(n-i)*sizeof(float) );
+    for (int k=0; k<n-i; k++)
+      sum += buf[k];
+  }
+  s = _mm_add_ps( s,_mm_movehl_ps(s,s) );
+  s = _mm_add_ss( s,_mm_shuffle_ps(s,s,1) );
+  return sum + _mm_cvtss_f32(s);
+}
+template< int D >
+static void vsigmoid_sse( int n,const float *x,float *y,float lo,float hi ) {
+  const __m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+  int i=0;
+  for ( ; i+4<=n; i+=4)
+    _mm_storeu_ps( y+i, sigmoid_sse<D>( _mm_loadu_ps(x+i),vlo,vhi ) );
+  if (i<n) {
+    float buf[4]{};
+    std::memcpy( buf,x+i,(n-i)*sizeof(float) );
+    _mm_storeu_ps( buf, sigmoid_sse<D>( _mm_loadu_ps(buf),vlo,vhi ) );
+    std::memcpy( y+i,buf,(n-i)*sizeof(float) );
+  }
+}
+
+#endif // SIMD_X86
+
+/*
+ * Dispatchers; the generic case is the scalar code
+ */
+void vexp( int n,const float *x,float *y ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : map_avx512<exp_avx512<>>(n,x,y); break;
+  case simd_isa::avx2   : map_avx2  <exp_avx2<>>  (n,x,y); break;
+  case simd_isa::sse    : map_sse   <exp_sse<>>   (n,x,y); break;
+#endif
+  default :
+    for (int i=0; i<n; i++)
+      y[i] = exp_poly( x[i] );
+  }
+}
+
+float vexp_sum( int n,const float *x,float shift,float *y,int approximation ) {
+  float s{0.f};
+  with_exp_degree
+    ( approximation,[&] ( auto d ) {
+      constexpr int D = decltype(d)::value;
+      switch (simd_level()) {
+#ifdef SIMD_X86
+      case simd_isa::avx512 : s = vexp_sum_avx512<D>(n,x,shift,y); break;
+      case simd_isa::avx2   : s = vexp_sum_avx2  <D>(n,x,shift,y); break;
+      case simd_isa::sse    : s = vexp_sum_sse   <D>(n,x,shift,y); break;
+#endif
+      default :
+	for (int i=0; i<n; i++) {
+	  y[i] = exp_approx<D>( x[i]-shift );
+	  s += y[i];
+	}
+      }
+    } );
+  return s;
+}
+
+// the three sweeps of vmath_impl_reference.cpp, for SSE and the generic case
+static void vsoftmax_by_sum
+    ( int n,const float *x,float *y,float lo,float hi,float *logy,int approximation ) {
+  const float xmax = *std::max_element( x,x+n );
+  float sum;
+  if (logy==nullptr)
+    sum = vexp_sum( n,x,xmax,y,approximation );
+  else {
+    for (int i=0; i<n; i++)
+      logy[i] = x[i] - xmax;
+    sum = vexp_sum( n,logy,0.f,y,approximation );
+    const float logsum = std::log(sum);
+    for (int i=0; i<n; i++)
+      logy[i] -= logsum;
+  }
+  const float scale = 1.f/sum;
+  for (int i=0; i<n; i++) {
+    float e = y[i]*scale;
+    e = ( e<lo ? lo : e );
+    y[i] = ( e>hi ? hi : e );
+  }
+}
+
+void vsoftmax( int n,const float *x,float *y,float lo,float hi,float *logy,
+	       int approximation ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 :
+    with_exp_degree
+      ( approximation,[&] ( auto d ) {
+	constexpr int D = decltype(d)::value;
+	float max,sum;
+	vmax_expsum_avx512<D>(n,x,&max,&sum);
+	vsoftmax_normalize_avx512<D>(n,x,max,1.f/sum,std::log(sum),lo,hi,y,logy);
+      } );
+    break;
+  case simd_isa::avx2 :
+    with_exp_degree
+      ( approximation,[&] ( auto d ) {
+	constexpr int D = decltype(d)::value;
+	float max,sum;
+	vmax_expsum_avx2<D>(n,x,&max,&sum);
+	vsoftmax_normalize_avx2<D>(n,x,max,1.f/sum,std::log(sum),lo,hi,y,logy);
+      } );
+    break;
+#endif
+  default : vsoftmax_by_sum( n,x,y,lo,hi,logy,approximation );
+  }
+}
+
+void vsigmoid( int n,const float *x,float *y,float lo,float hi,int approximation ) {
+  with_exp_degree
+    ( approximation,[&] ( auto d ) {
+      constexpr int D = decltype(d)::value;
+      switch (simd_level()) {
+#ifdef SIMD_X86
+      case simd_isa::avx512 : vsigmoid_avx512<D>(n,x,y,lo,hi); break;
+      case simd_isa::avx2   : vsigmoid_avx2  <D>(n,x,y,lo,hi); break;
+      case simd_isa::sse    : vsigmoid_sse   <D>(n,x,y,lo,hi); break;
+#endif
+      default :
+	for (int i=0; i<n; i++) {
+	  float e = 1.f/( 1.f+exp_approx<D>( -x[i] ) );
+	  e = ( e<lo ? lo : e );
+	  y[i] = ( e>hi ? hi : e );
+	}
+      }
+    } );
+}
+
+void vtanh( int n,const float *x,float *y ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : map_avx512<tanh_avx512>(n,x,y); break;
+  case simd_isa::avx2   : map_avx2  <tanh_avx2>  (n,x,y); break;
+  case simd_isa::sse    : map_sse   <tanh_sse>   (n,x,y); break;
+#endif
+  default :
+    for (int i=0; i<n; i++)
+      y[i] = tanh_poly( x[i] );
+  }
+}
+
+void vsilu( int n,const float *x,float *y ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : map_avx512<silu_avx512>(n,x,y); break;
+  case simd_isa::avx2   : map_avx2  <silu_avx2>  (n,x,y); break;
+  case simd_isa::sse    : map_sse   <silu_sse>   (n,x,y); break;
+#endif
+  default :
+    for (int i=0; i<n; i++)
+      y[i] = silu_poly( x[i] );
+  }
+}
+
+void vgelu( int n,const float *x,float *y ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : map_avx512<gelu_avx512>(n,x,y); break;
+  case simd_isa::avx2   : map_avx2  <gelu_avx2>  (n,x,y); break;
+  case simd_isa::sse    : map_sse   <gelu_sse>   (n,x,y); break;
+#endif
+  default :
+    for (int i=0; i<n; i++)
+      y[i] = gelu_poly( x[i] );
+  }
+}
+
+void velu( int n,const float *x,float *y ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : map_avx512<elu_avx512>(n,x,y); break;
+  case simd_isa::avx2   : map_avx2  <elu_avx2>  (n,x,y); break;
+  case simd_isa::sse    : map_sse   <elu_sse>   (n,x,y); break;
+#endif
+  default :
+    for (int i=0; i<n; i++)
+      y[i] = elu_poly( x[i] );
+  }
+}
+
+void vsilu_grad( int n,const float *x,float *g ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : map_avx512<silu_grad_avx512>(n,x,g); break;
+  case simd_isa::avx2   : map_avx2  <silu_grad_avx2>  (n,x,g); break;
+  case simd_isa::sse    : map_sse   <silu_grad_sse>   (n,x,g); break;
+#endif
+  default :
+    for (int i=0; i<n; i++)
+      g[i] = silu_grad_poly( x[i] );
+  }
+}
+
+void vgelu_grad( int n,const float *x,float *g ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : map_avx512<gelu_grad_avx512>(n,x,g); break;
+  case simd_isa::avx2   : map_avx2  <gelu_grad_avx2>  (n,x,g); break;
+  case simd_isa::sse    : map_sse   <gelu_grad_sse>   (n,x,g); break;
+#endif
+  default :
+    for (int i=0; i<n; i++)
+      g[i] = gelu_grad_poly( x[i] );
+  }
+}
+
+void velu_grad( int n,const float *a,float *g ) {
+  switch (simd_level()) {
+#ifdef SIMD_X86
+  case simd_isa::avx512 : map_avx512<elu_grad_avx512>(n,a,g); break;
+  case simd_isa::avx2   : map_avx2  <elu_grad_avx2>  (n,a,g); break;
+  case simd_isa::sse    : map_sse   <elu_grad_sse>   (n,a,g); break;
+#endif
+  default :
+    for (int i=0; i<n; i++)
+      g[i] = elu_grad_poly( a[i] );
+  }
+}
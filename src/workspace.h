@@ -0,0 +1,156 @@
+/****************************************************************
+ ****************************************************************
+ ****
+ **** This text file is part of the source of
+ **** `Introduction to High-Performance Scientific Computing'
+ **** by Victor Eijkhout, copyright 2012-2021
+ ****
+ **** Deep Learning Network code
+ **** copyright 2021 Ilknur Mustafazade
+ ****
+ ****************************************************************
+ ****************************************************************/
+
+#ifndef SRC_WORKSPACE_H
+#define SRC_WORKSPACE_H
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include "aligned.h"
+
+/*
+ * The values of a VectorBatch.
+ * Normally these are owned, in an aligned_vector;
+ * a batch can also be a view on memory owned by someone else.
+ * A writable view, typically a slice of a Workspace, keeps its pointer:
+ * resizing within the capacity of the slice only changes the size,
+ * and assigning to it copies into the slice.
+ * A read-only view, see VectorBatchView, never writes its parent:
+ * the first non-const access copies the values into owned storage.
+ * Growing either kind of view past its capacity
+ * also copies the values into owned storage.
+ * Copying a view gives an ordinary, owning, batch.
+ */
+class batch_storage {
+private:
+  aligned_vector owned;
+  float *borrowed{nullptr};
+  const float *viewed{nullptr};
+  int borrowed_size{0},borrowed_capacity{0};
+  //! stop being a view: copy the values into owned storage, with room for n
+  void detach( int n ) {
+    const float *from = borrowed!=nullptr ? borrowed : viewed;
+    aligned_vector values;
+    values.reserve( std::max(n,borrowed_size) );
+    values.assign( from,from+borrowed_size );
+    borrowed = nullptr; viewed = nullptr; borrowed_size = 0; borrowed_capacity = 0;
+    owned = std::move(values);
+  };
+public:
+  batch_storage() = default;
+  batch_storage( float *p,int capacity )
+    : borrowed(p),borrowed_capacity(capacity) {};
+  bool is_view() const { return borrowed!=nullptr or viewed!=nullptr; };
+  bool read_only() const { return viewed!=nullptr; };
+  //! become a view on the n floats at p, initially of size zero
+  void borrow( float *p,int n ) {
+    aligned_vector().swap(owned);
+    borrowed = p; viewed = nullptr; borrowed_size = 0; borrowed_capacity = n;
+  };
+  //! become a read-only view on the n floats at p, initially of size zero
+  void view( const float *p,int n ) {
+    aligned_vector().swap(owned);
+    borrowed = nullptr; viewed = p; borrowed_size = 0; borrowed_capacity = n;
+  };
+  //! give up the values, owned or viewed: back to an empty owning storage
+  void release() {
+    aligned_vector().swap(owned);
+    borrowed = nullptr; viewed = nullptr; borrowed_size = 0; borrowed_capacity = 0;
+  };
+  int capacity() const { return is_view() ? borrowed_capacity : owned.capacity(); };
+
+  int size() const { return is_view() ? borrowed_size : owned.size(); };
+  bool empty() const { return size()==0; };
+  void resize( int n ) {
+    if (is_view() and n>borrowed_capacity)
+      detach(n);
+    if (is_view())
+      borrowed_size = n;
+    else
+      owned.resize(n);
+  };
+  float *data() {
+    if (read_only()) detach(size());
+    return is_view() ? borrowed : owned.data(); };
+  const float *data() const {
+    return borrowed!=nullptr ? borrowed : viewed!=nullptr ? viewed : owned.data(); };
+  float *begin() { return data(); };
+  float *end() { return data()+size(); };
+  const float *begin() const { return data(); };
+  const float *end() const { return data()+size(); };
+  float &operator[]( int i ) { return data()[i]; };
+  const float &operator[]( int i ) const { return data()[i]; };
+  float &at( int i ) {
+    if (i<0 or i>=size()) throw std::out_of_range("batch_storage::at");
+    return data()[i];
+  };
+  const float &at( int i ) const {
+    if (i<0 or i>=size()) throw std::out_of_range("batch_storage::at");
+    return data()[i];
+  };
+  template< typename It >
+  void assign( It first,It last ) {
+    if (read_only()) release();
+    resize( last-first );
+    std::copy( first,last,begin() );
+  };
+
+  batch_storage( const batch_storage &other )
+    : owned( other.begin(),other.end() ) {};
+  batch_storage( batch_storage&& ) = default;
+  batch_storage &operator=( const batch_storage &other ) {
+    if (this!=&other)
+      assign( other.begin(),other.end() );
+    return *this;
+  };
+  batch_storage &operator=( batch_storage &&other ) {
+    if (read_only()) release();
+    if (is_view())
+      assign( other.begin(),other.end() );
+    else {
+      owned = std::move(other.owned);
+      borrowed = other.borrowed; viewed = other.viewed;
+      borrowed_size = other.borrowed_size; borrowed_capacity = other.borrowed_capacity;
+    }
+    return *this;
+  };
+};
+
+/*
+ * One allocation for all the batch temporaries of a network.
+ * The owner adds up what it needs, reserves it once,
+ * and then hands out slices, each starting on a cache line.
+ */
+class Workspace {
+private:
+  aligned_vector memory;
+  int used{0};
+public:
+  //! room that a slice of n floats takes up
+  static int slice_size( int n ) { return padded_size(n); };
+  void reserve( int nfloats ) {
+    memory = aligned_vector(nfloats); used = 0;
+  };
+  float *carve( int n ) {
+    const int s = slice_size(n);
+    assert( used+s<=static_cast<int>(memory.size()) );
+    float *slice = memory.data()+used;
+    used += s;
+    return slice;
+  };
+  //! total size, in bytes
+  long bytes() const { return static_cast<long>( memory.size() )*sizeof(float); };
+};
+
+#endif //SRC_WORKSPACE_H